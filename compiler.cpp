@@ -7,15 +7,33 @@
 #include <stdint.h>
 #include <string_view>
 #include <vector>
+#include <deque>
+#include <array>
 #include <optional>
+#include <bit>
 #include <functional>
 #include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <memory>
+#include <type_traits>
 #include <assert.h>
+#if defined(_WIN32)
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "script.hpp"
 
 #define DEBUG_LEXPARSE 0
 #define DEBUG_WALK
 //#define DEBUG_PARSE
+// keeps FaeVM::var_table, a registry of the live heap objects
+#if !defined(FAE_HEAP_REGISTRY)
+#define FAE_HEAP_REGISTRY 0
+#endif
 
 using namespace std::string_view_literals;
 
@@ -67,84 +85,175 @@ bool is_vtype_pointer(VarType v) {
 	return variable_type_is_pointer[static_cast<size_t>(v)];
 }
 
-struct VMVar {
-	virtual ~VMVar() {}
-	virtual VarType get_type() const { return VarType::Unset; }
+#if FAE_HEAP_REGISTRY
+struct VMVar;
+// names a registry slot, the generation tells a reused slot from the old one
+struct HeapId {
+	uint32_t index;
+	uint32_t generation;
 };
-struct VarRef {
-	VMVar *ptr;
-	uint32_t ref_count;
-	uint32_t weak_count;
-	VarRef() : ptr{nullptr}, ref_count{0}, weak_count{0} {}
-	VarRef(VMVar *p) : ptr{p}, ref_count{1}, weak_count{1} {}
-	VarRef(const VarRef &c) = delete;
-	VarRef& operator=(const VarRef &c) = delete;
-	explicit VarRef(VarRef &&c) : ptr{c.ptr}, ref_count{c.ref_count}, weak_count{c.weak_count} {
-		c.ptr = nullptr;
-		c.ref_count = 0;
-		c.weak_count = 0;
-	}
-	VarRef& operator=(VarRef &&c) {
-		ptr = c.ptr;
-		ref_count = c.ref_count;
-		weak_count = c.weak_count;
-		c.ptr = nullptr;
-		c.ref_count = 0;
-		c.weak_count = 0;
-		return *this;
+// debug registry of the live heap objects. freed slots are kept on a free
+// list and reused, so the registry stays as big as the live heap
+struct HeapRegistry {
+	static constexpr uint32_t no_slot = ~uint32_t{0};
+	struct Slot {
+		VMVar *ptr = nullptr;
+		uint32_t generation = 0;
+		uint32_t next_free = no_slot;
+	};
+	std::vector<Slot> slots;
+	uint32_t free_head = no_slot;
+	size_t live = 0;
+	size_t peak_live = 0;
+	HeapId add(VMVar *v) {
+		uint32_t index = free_head;
+		if(index == no_slot) {
+			index = static_cast<uint32_t>(slots.size());
+			slots.emplace_back();
+		} else {
+			free_head = slots[index].next_free;
+		}
+		auto &slot = slots[index];
+		slot.ptr = v;
+		slot.next_free = no_slot;
+		live++;
+		peak_live = std::max(peak_live, live);
+		// a new slot is only made when every slot is in use
+		assert(slots.size() == peak_live);
+		return HeapId{index, slot.generation};
 	}
-	VMVar* operator->() const {
-		return ptr;
+	void remove(HeapId id) {
+		auto &slot = slots[id.index];
+		assert(slot.generation == id.generation && slot.ptr);
+		slot.ptr = nullptr;
+		slot.generation++;
+		slot.next_free = free_head;
+		free_head = id.index;
+		live--;
+	}
+	// nullptr when the object was freed, even if the slot has been reused
+	VMVar *find(HeapId id) const {
+		if(id.index >= slots.size()) return nullptr;
+		auto &slot = slots[id.index];
+		return slot.generation == id.generation ? slot.ptr : nullptr;
+	}
+};
+#endif
+
+// links of the list of every heap object, which the collector sweeps
+struct HeapLinks {
+	HeapLinks *heap_prev = nullptr;
+	HeapLinks *heap_next = nullptr;
+	void unlink() {
+		if(!heap_next) return;
+		heap_prev->heap_next = heap_next;
+		heap_next->heap_prev = heap_prev;
+		heap_prev = heap_next = nullptr;
+	}
+};
+struct HeapCollector;
+struct VMVar;
+// objects whose count dropped to zero. a stack or accumulator may still
+// point at them, FaeVM::reconcile_counts frees the ones none do
+struct ZeroCountTable {
+	std::vector<VMVar*> entries;
+};
+
+// heap objects count the references held by other heap objects, scopes and
+// tables. stack and accumulator references are not counted, so the last
+// release only queues the object on the zero count table. cycles are left
+// to the collector
+struct VMVar : HeapLinks {
+	uint32_t ref_count = 0;
+	// epoch of the last collection that reached this object
+	uint32_t mark = 0;
+	// set by FaeVM::put_variable
+	ZeroCountTable *zct = nullptr;
+	// epoch of the last reconcile that found this object on a stack
+	uint32_t stack_mark = 0;
+	bool in_zct = false;
+#if FAE_HEAP_REGISTRY
+	// set by FaeVM::put_variable, the slot is released when the object is freed
+	HeapRegistry *registry = nullptr;
+	HeapId heap_id{};
+	virtual ~VMVar() {
+		if(registry) registry->remove(heap_id);
+		unlink();
 	}
-	VMVar* get() const {
-		return ptr;
+#else
+	virtual ~VMVar() {
+		unlink();
 	}
+#endif
+	virtual VarType get_type() const { return VarType::Unset; }
+	// hands the registers and scopes this object holds to the collector
+	virtual void trace(HeapCollector &) {}
+	// lets go of them, the collector uses this to take garbage cycles apart
+	virtual void clear_refs() {}
+	virtual size_t heap_size() const { return sizeof(VMVar); }
 	void add_ref() {
 		ref_count++;
-		weak_count++;
 	}
 	void del_ref() {
-		if(ref_count > 0 && weak_count >= ref_count) {
-			ref_count--;
-			weak_count--;
-			if(!ref_count && ptr) {
-				delete ptr;
-				ptr = nullptr;
-			}
-		} else {
-			// error?!
-		}
-	}
-	bool reset(VMVar *p) {
-		if(ref_count > 1 || weak_count > 1) return false;
-		if(ref_count && ptr) {
-			delete ptr;
+		if(--ref_count == 0 && !in_zct) {
+			in_zct = true;
+			zct->entries.push_back(this);
 		}
-		ptr = p;
-		ref_count = 1;
-		weak_count = 1;
-		return true;
 	}
 };
 
+// heap values point directly at their object. a plain register holds no
+// count, it is what the value stack and the accumulator are made of
 struct Register {
-	FaeVM &vm;
 	uint64_t value;
 	VarType vtype;
-	Register() = delete;
-	~Register();
-	Register(FaeVM &_vm);
-	Register(const Register &v);
-	Register(Register &&v);
-	Register& operator=(const Register &v);
-	Register& operator=(Register &&v);
-	Register(FaeVM &_vm, uint64_t v)
-		: vm{_vm}, value{v}, vtype{VarType::Integer} {}
-	Register(FaeVM &_vm, int64_t v)
-		: vm{_vm}, value{static_cast<uint64_t>(v)}, vtype{VarType::Integer} {}
-	Register(FaeVM &_vm, uint64_t v, VarType t)
-		: vm{_vm}, value{v}, vtype{t} {}
+	Register() : value{0}, vtype{VarType::Unset} {}
+	Register(uint64_t v)
+		: value{v}, vtype{VarType::Integer} {}
+	Register(int64_t v)
+		: value{static_cast<uint64_t>(v)}, vtype{VarType::Integer} {}
+	Register(uint64_t v, VarType t)
+		: value{v}, vtype{t} {}
+	Register(VMVar &v, VarType t)
+		: value{reinterpret_cast<uint64_t>(&v)}, vtype{t} {}
+	VMVar *ptr() const {
+		return reinterpret_cast<VMVar*>(value);
+	}
+};
+static_assert(sizeof(Register) == 16);
+static_assert(std::is_trivially_copyable_v<Register>);
+// a register stored in a heap object, scope or table, it holds a count
+struct HeapRegister : Register {
+	HeapRegister() = default;
+	HeapRegister(const Register &v) : Register{v} { retain(); }
+	HeapRegister(const HeapRegister &v) : Register{v} { retain(); }
+	HeapRegister(HeapRegister &&v) : Register{v} { v.vtype = VarType::Unset; }
+	~HeapRegister() { release(); }
+	HeapRegister &operator=(const Register &v) {
+		HeapRegister{v}.swap(*this);
+		return *this;
+	}
+	HeapRegister &operator=(const HeapRegister &v) {
+		HeapRegister{v}.swap(*this);
+		return *this;
+	}
+	HeapRegister &operator=(HeapRegister &&v) {
+		HeapRegister{std::move(v)}.swap(*this);
+		return *this;
+	}
+private:
+	void swap(HeapRegister &other) {
+		std::swap(value, other.value);
+		std::swap(vtype, other.vtype);
+	}
+	void retain() {
+		if(is_vtype_pointer(vtype)) ptr()->add_ref();
+	}
+	void release() {
+		if(is_vtype_pointer(vtype)) ptr()->del_ref();
+	}
 };
+static_assert(sizeof(HeapRegister) == 16);
 
 #define GENERATE_ENUM_LIST(f) f,
 #define GENERATE_STRING_LIST(f) #f##sv,
@@ -1095,18 +1204,27 @@ Token::t, Expr::cl, ASTSlots::num, LexTokenRange{s1->block.tk_begin, s2->block.t
 Token::t, Expr::cl, ASTSlots::num, LexTokenRange{s->block.tk_begin, s->block.tk_end, Token::t});
 
 #define DEF_OPCODES(f) \
-	f(LoadUnit) f(LoadConst) f(LoadBool) f(LoadString) f(LoadClosure) \
-	f(LoadNewObject) f(LoadNewArray) \
+	f(LoadUnit) f(LoadConst) f(LoadBool) f(LoadString) f(LoadConstRef) f(LoadClosure) \
+	f(LoadNewObject) f(LoadNewArray) f(NewObjectFromTemplate) \
 	f(LoadVariable) f(StoreVariable) f(LoadArg) f(StoreArg) \
 	f(LoadLocal) f(StoreLocal) f(LoadStack) f(StoreStack) \
-	f(NamedArgLookup) f(NamedLookup) f(AssignNamed) \
+	f(NamedArgLookup) f(NamedLookup) f(AssignNamed) f(NamedLookupSite) f(AssignNamedSite) \
 	f(PushRegister) f(PopRegister) f(PopStack) \
 	f(CallExpression) f(ExitScope) f(ExitFunction) \
 	f(Jump) f(JumpIf) f(JumpElse) \
 	f(AddInteger) f(SubInteger) f(MulInteger) f(DivInteger) f(ModInteger) f(PowInteger) \
-	f(Negate) f(Not) \
+	f(SquareInteger) f(MulStackInteger) f(MulConstInteger) \
+	f(LSHConstInteger) f(RSHLConstInteger) f(AndConstInteger) \
+	f(DivMagicInteger) f(ModMagicInteger) \
+	f(NegateInteger) f(Not) \
 	f(AndInteger) f(OrInteger) f(XorInteger) \
 	f(LSHInteger) f(RSHLInteger) f(RSHAInteger) \
+	f(AndBool) f(OrBool) f(XorBool) \
+	f(CompareLessInteger) f(CompareGreaterInteger) \
+	f(CompareLessEqualInteger) f(CompareGreaterEqualInteger) \
+	f(GuardInteger) \
+	f(Add) f(Sub) f(Mul) f(Div) f(Mod) f(Pow) f(Negate) \
+	f(And) f(Or) f(Xor) f(LSH) f(RSHL) f(RSHA) \
 	f(CompareLess) f(CompareGreater) f(CompareEqual) f(CompareNotEqual) \
 	f(CompareLessEqual) f(CompareGreaterEqual) f(CompareSpaceship)
 enum class Opcode {
@@ -1146,6 +1264,203 @@ std::ostream &operator<<(std::ostream &os, const Instruction &v) {
 	return os;
 }
 
+// compact code: one 32 bit word per instruction, 8 bit opcode and 24 bit operand.
+// operands that do not fit are marked wide and follow as two extra words (low, high).
+// pair operands (up count, index) pack as 8 and 16 bits when inline.
+// jump operands are word offsets in code, and instruction indexes in an Instruction list.
+constexpr uint32_t operand_shift = 8;
+constexpr uint32_t operand_wide = 0xffffff;
+static_assert(std::size(opcode_names) <= 0x100, "opcodes must fit in 8 bits");
+constexpr bool opcode_has_pair_operand(Opcode op) {
+	switch(op) {
+	case Opcode::LoadVariable:
+	case Opcode::StoreVariable:
+	case Opcode::LoadLocal:
+	case Opcode::StoreLocal:
+	case Opcode::LoadArg:
+		return true;
+	default:
+		return false;
+	}
+}
+constexpr bool opcode_is_jump(Opcode op) {
+	return op == Opcode::Jump || op == Opcode::JumpIf || op == Opcode::JumpElse;
+}
+static bool operand_fits_inline(const Instruction &ins) {
+	if(opcode_has_pair_operand(ins.opcode))
+		return ins.param_a < 0x100 && ins.param_b < 0xffff;
+	return ins.param < operand_wide;
+}
+inline const uint32_t *decode_instruction(const uint32_t *pc, Instruction &out) {
+	uint32_t word = *pc++;
+	out.opcode = static_cast<Opcode>(word & 0xff);
+	uint32_t operand = word >> operand_shift;
+	if(operand == operand_wide) {
+		out.param = pc[0] | (static_cast<uint64_t>(pc[1]) << 32);
+		return pc + 2;
+	}
+	if(opcode_has_pair_operand(out.opcode)) {
+		out.param_a = operand & 0xff;
+		out.param_b = operand >> 8;
+	} else {
+		out.param = operand;
+	}
+	return pc;
+}
+static std::vector<uint32_t> encode_code(const std::vector<Instruction> &list) {
+	size_t count = list.size();
+	auto jump_index = [&](const Instruction &ins) { return std::min<uint64_t>(ins.param, count); };
+	std::vector<bool> wide(count);
+	for(size_t i = 0; i < count; i++)
+		wide[i] = !opcode_is_jump(list[i].opcode) && !operand_fits_inline(list[i]);
+	// jumps start inline and only widen when their target offset grows too large
+	std::vector<size_t> offsets(count + 1);
+	for(bool changed = true; changed;) {
+		changed = false;
+		for(size_t i = 0; i < count; i++) offsets[i + 1] = offsets[i] + (wide[i] ? 3 : 1);
+		for(size_t i = 0; i < count; i++) {
+			if(!wide[i] && opcode_is_jump(list[i].opcode) && offsets[jump_index(list[i])] >= operand_wide) {
+				wide[i] = true;
+				changed = true;
+			}
+		}
+	}
+	std::vector<uint32_t> code;
+	code.reserve(offsets[count]);
+	for(size_t i = 0; i < count; i++) {
+		Instruction ins = list[i];
+		if(opcode_is_jump(ins.opcode)) ins.param = offsets[jump_index(ins)];
+		uint32_t opcode = static_cast<uint32_t>(ins.opcode);
+		if(wide[i]) {
+			code.push_back(opcode | (operand_wide << operand_shift));
+			code.push_back(static_cast<uint32_t>(ins.param));
+			code.push_back(static_cast<uint32_t>(ins.param >> 32));
+		} else if(opcode_has_pair_operand(ins.opcode)) {
+			code.push_back(opcode | ((ins.param_a | (ins.param_b << 8)) << operand_shift));
+		} else {
+			code.push_back(opcode | (static_cast<uint32_t>(ins.param) << operand_shift));
+		}
+	}
+	return code;
+}
+static bool decode_code(const std::vector<uint32_t> &code, std::vector<Instruction> &list) {
+	// fails on unknown opcodes, cut off wide operands and jumps into the middle of an instruction
+	std::vector<size_t> index_at(code.size() + 1, SIZE_MAX);
+	list.clear();
+	const uint32_t *pc = code.data();
+	const uint32_t *end = pc + code.size();
+	while(pc != end) {
+		if((*pc & 0xff) >= std::size(opcode_names)) return false;
+		if((*pc >> operand_shift) == operand_wide && end - pc < 3) return false;
+		index_at[pc - code.data()] = list.size();
+		Instruction ins{Opcode::LoadUnit};
+		pc = decode_instruction(pc, ins);
+		list.push_back(ins);
+	}
+	index_at[code.size()] = list.size();
+	for(auto &ins : list) {
+		if(!opcode_is_jump(ins.opcode)) continue;
+		if(ins.param > code.size() || index_at[ins.param] == SIZE_MAX) return false;
+		ins.param = index_at[ins.param];
+	}
+	return true;
+}
+struct Shape;
+// member names of an object literal, in the order its values are pushed
+struct ObjectTemplate {
+	std::vector<size_t> names;
+	// set by load_module, the shape of an object with these members
+	Shape *shape = nullptr;
+};
+// operand stack use of one instruction: values it reads below the top, and the change in depth
+struct StackEffect {
+	uint64_t needs;
+	int64_t delta;
+};
+static StackEffect stack_effect(const Instruction &ins, std::span<const ObjectTemplate> templates) {
+	switch(ins.opcode) {
+	case Opcode::NewObjectFromTemplate: {
+		uint64_t count = ins.param < templates.size() ? templates[ins.param].names.size() : 0;
+		return {count, -static_cast<int64_t>(count)};
+	}
+	case Opcode::PushRegister: return {0, 1};
+	case Opcode::PopRegister: return {1, -1};
+	case Opcode::PopStack: return {ins.param + 1, -static_cast<int64_t>(ins.param + 1)};
+	case Opcode::LoadStack:
+	case Opcode::StoreStack: return {ins.param + 1, 0};
+	case Opcode::LoadNewArray: return {ins.param, -static_cast<int64_t>(ins.param)};
+	case Opcode::CallExpression: return {ins.param, 0};
+	case Opcode::AssignNamed:
+	case Opcode::AssignNamedSite:
+	case Opcode::MulStackInteger: return {1, 0};
+	case Opcode::AddInteger: case Opcode::SubInteger: case Opcode::MulInteger:
+	case Opcode::DivInteger: case Opcode::ModInteger: case Opcode::PowInteger:
+	case Opcode::AndInteger: case Opcode::OrInteger: case Opcode::XorInteger:
+	case Opcode::LSHInteger: case Opcode::RSHLInteger: case Opcode::RSHAInteger:
+	case Opcode::AndBool: case Opcode::OrBool: case Opcode::XorBool:
+	case Opcode::CompareLessInteger: case Opcode::CompareGreaterInteger:
+	case Opcode::CompareLessEqualInteger: case Opcode::CompareGreaterEqualInteger:
+	case Opcode::Add: case Opcode::Sub: case Opcode::Mul:
+	case Opcode::Div: case Opcode::Mod: case Opcode::Pow:
+	case Opcode::And: case Opcode::Or: case Opcode::Xor:
+	case Opcode::LSH: case Opcode::RSHL: case Opcode::RSHA:
+	case Opcode::CompareLess: case Opcode::CompareGreater:
+	case Opcode::CompareEqual: case Opcode::CompareNotEqual:
+	case Opcode::CompareLessEqual: case Opcode::CompareGreaterEqual:
+	case Opcode::CompareSpaceship:
+		return {1, -1};
+	default: return {0, 0};
+	}
+}
+struct OperandStackCheck {
+	size_t bad_index = SIZE_MAX;
+	const char *why = nullptr;
+	size_t max_depth = 0;
+};
+static OperandStackCheck check_operand_stack(const std::vector<Instruction> &list, std::span<const ObjectTemplate> templates) {
+	// operand stack depth on entry to each instruction, found by walking every path once.
+	// reads may not go below the frame's operand base and paths must agree where they join
+	OperandStackCheck result;
+	constexpr int64_t unvisited = -1;
+	std::vector<int64_t> depth_at(list.size(), unvisited);
+	std::vector<size_t> pending;
+	auto reach = [&](size_t target, int64_t depth) {
+		if(target == list.size()) return true; // leaving the frame drops the operand stack
+		if(depth_at[target] == unvisited) {
+			depth_at[target] = depth;
+			pending.push_back(target);
+			return true;
+		}
+		return depth_at[target] == depth;
+	};
+	if(!list.empty()) reach(0, 0);
+	while(!pending.empty()) {
+		size_t index = pending.back();
+		pending.pop_back();
+		auto &ins = list[index];
+		int64_t depth = depth_at[index];
+		auto effect = stack_effect(ins, templates);
+		auto stop = [&](const char *why) {
+			result.bad_index = index;
+			result.why = why;
+			return result;
+		};
+		if(static_cast<uint64_t>(depth) < effect.needs) return stop("operand stack underflow");
+		depth += effect.delta;
+		result.max_depth = std::max(result.max_depth, static_cast<size_t>(depth));
+		bool falls_through = true;
+		if(ins.opcode == Opcode::ExitFunction) {
+			falls_through = false;
+		} else if(opcode_is_jump(ins.opcode)) {
+			if(!reach(ins.param, depth)) return stop("stack depth differs at jump target");
+			falls_through = ins.opcode != Opcode::Jump;
+		}
+		if(falls_through && !reach(index + 1, depth))
+			return stop("stack depth differs at the next instruction");
+	}
+	return result;
+}
+
 struct FrameContext;
 
 struct VariableDeclaration {
@@ -1153,6 +1468,27 @@ struct VariableDeclaration {
 	bool is_closed;
 	bool is_arg;
 	bool is_mut;
+	// function expression bound by "let", candidate for inlining at call sites
+	const ASTNode *bound_function = nullptr;
+	size_t bound_frame = 0;
+	// hidden local holding an argument of an inlined call
+	const ASTNode *inline_site = nullptr;
+	size_t inline_arg = 0;
+	// static type, joined over every value stored to the variable
+	VarType value_type = VarType::Unset;
+	bool type_seen = false;
+	bool initialized = false;
+	size_t init_region = 0;
+	bool merge_type(VarType t) {
+		if(!type_seen) {
+			type_seen = true;
+			value_type = t;
+			return true;
+		}
+		if(value_type == t || value_type == VarType::Unset) return false;
+		value_type = VarType::Unset;
+		return true;
+	}
 	VariableDeclaration(size_t n, bool arg) :
 		name_index{n}, is_closed{false}, is_arg{arg}, is_mut{false} {}
 	VariableDeclaration(size_t n, bool arg, bool m) :
@@ -1183,16 +1519,95 @@ struct FrameContext {
 	std::vector<VariableDeclaration> var_declarations;
 	std::vector<VariableDeclaration> arg_declarations;
 	std::vector<FrameScopeContext> scopes;
+	// emitter output, encoded into code at the end of the code pass
 	std::vector<Instruction> instructions;
+	std::vector<uint32_t> code;
+	// deepest operand stack use of the code, reserved at frame entry
+	size_t max_stack = 0;
 	FrameContext(size_t scope_id) : frame_index{scope_id}, current_closed{0}, current_depth{0}, current_var{0} {}
 	FrameContext(size_t scope_id, std::shared_ptr<FrameContext> &up_ptr)
 		: frame_index{scope_id}, up{up_ptr}, current_closed{0}, current_depth{0}, current_var{0} {}
 };
 typedef std::shared_ptr<FrameContext> framectx_ptr;
+// unsigned division by a constant: q = (t + ((n - t) >> 1)) >> shift, t = mul_high(n, multiplier)
+struct DivisorMagic {
+	uint64_t divisor;
+	uint64_t multiplier;
+	uint32_t shift;
+};
+static uint64_t mul_high(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+	return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#else
+	uint64_t a_lo = a & 0xffffffffu, a_hi = a >> 32;
+	uint64_t b_lo = b & 0xffffffffu, b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+	uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffffu) + lo_hi;
+	return hi_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+static DivisorMagic make_divisor_magic(uint64_t divisor) {
+	// divisor must not be zero or a power of two
+	uint32_t log_ceil = 64 - std::countl_zero(divisor - 1);
+	// multiplier = floor(2^64 * (2^log_ceil - divisor) / divisor) + 1
+	uint64_t remainder = log_ceil == 64 ? (0 - divisor) : ((uint64_t{1} << log_ceil) - divisor);
+	uint64_t quotient = 0;
+	for(int bit = 0; bit < 64; bit++) {
+		bool carry = (remainder >> 63) != 0;
+		remainder <<= 1;
+		quotient <<= 1;
+		if(carry || remainder >= divisor) {
+			remainder -= divisor;
+			quotient |= 1;
+		}
+	}
+	return DivisorMagic{divisor, quotient + 1, log_ceil - 1};
+}
+static uint64_t divide_magic(const DivisorMagic &magic, uint64_t n) {
+	uint64_t t = mul_high(n, magic.multiplier);
+	return (t + ((n - t) >> 1)) >> magic.shift;
+}
 struct VariableExtern {
 	string var_name;
 	uint32_t pos;
 };
+// shapes one NamedLookupSite or AssignNamedSite has seen, and where the
+// member was in each. up to poly_limit shapes are kept, after that the
+// site is megamorphic and always asks the shape
+struct InlineCache {
+	static constexpr size_t poly_limit = 4;
+	static constexpr uint32_t miss = ~uint32_t{0};
+	struct Entry {
+		const Shape *shape;
+		// set when an assignment added the member, the shape it moved to
+		Shape *next;
+		uint32_t slot;
+	};
+	std::array<Entry, poly_limit> entries;
+	uint8_t count = 0;
+	bool megamorphic = false;
+	const Entry *find(const Shape *shape) const {
+		for(uint8_t i = 0; i < count; i++) {
+			if(entries[i].shape == shape) return &entries[i];
+		}
+		return nullptr;
+	}
+	void record(const Entry &entry) {
+		if(megamorphic) return;
+		if(count == poly_limit) {
+			megamorphic = true;
+			count = 0;
+			return;
+		}
+		entries[count++] = entry;
+	}
+};
+// a named member access in linked code, the instruction operand indexes these
+struct NamedSite {
+	size_t name;
+	InlineCache cache;
+};
 struct ModuleContext {
 	ModuleSource source;
 	std::vector<size_t> line_positions;
@@ -1200,6 +1615,17 @@ struct ModuleContext {
 	std::vector<std::string_view> string_table;
 	std::shared_ptr<FrameContext> root_context;
 	std::vector<std::shared_ptr<FrameContext>> frames;
+	std::vector<DivisorMagic> divisor_table;
+	std::vector<ObjectTemplate> object_templates;
+	// immutable literal values built by load_module, LoadConstRef indexes these
+	std::vector<HeapRegister> constants;
+	// one per NamedLookupSite and AssignNamedSite, built by load_module
+	std::vector<NamedSite> named_sites;
+	// backing storage of a module loaded from an image, string_table points into it
+	std::shared_ptr<const void> image;
+	CompileStats stats;
+	// set by load_module when the code passed verify_module
+	bool verified = false;
 	ModuleContext(std::string &&source) : source{ModuleSource{std::move(source)}} {
 		this->find_or_put_string(string_table_empty_string);
 		this->root_context = std::make_shared<FrameContext>(FrameContext{0});
@@ -1213,6 +1639,22 @@ struct ModuleContext {
 		this->string_table.push_back(s);
 		return this->string_table.size() - 1; // newly inserted string
 	}
+	size_t find_or_put_divisor(uint64_t divisor) {
+		auto found = std::ranges::find(this->divisor_table, divisor, &DivisorMagic::divisor);
+		if(found != this->divisor_table.cend()) {
+			return found - this->divisor_table.cbegin();
+		}
+		this->divisor_table.push_back(make_divisor_magic(divisor));
+		return this->divisor_table.size() - 1;
+	}
+	size_t find_or_put_template(std::vector<size_t> names) {
+		auto found = std::ranges::find(this->object_templates, names, &ObjectTemplate::names);
+		if(found != this->object_templates.cend()) {
+			return found - this->object_templates.cbegin();
+		}
+		this->object_templates.push_back(ObjectTemplate{std::move(names)});
+		return this->object_templates.size() - 1;
+	}
 	void add_import(string import_name) {
 		imports.emplace_back(std::make_unique<VariableExtern>(VariableExtern{import_name, 0}));
 		auto import_ptr = imports.back().get();
@@ -1227,6 +1669,17 @@ struct ModuleContext {
 	}
 };
 
+struct PhaseTimer {
+	// adds the lifetime of the timer to a stats counter
+	uint64_t &total;
+	std::chrono::steady_clock::time_point start;
+	PhaseTimer(uint64_t &t) : total{t}, start{std::chrono::steady_clock::now()} {}
+	~PhaseTimer() {
+		total += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	}
+};
+
 struct devnull {};
 template<typename T>
 constexpr const devnull& operator<<(const devnull &n, const T &t) {
@@ -1291,27 +1744,107 @@ bool convert_number_bin(std::string_view raw_number, uint64_t &output) {
 	return true;
 }
 
+static bool literal_value(const node_ptr &node, uint64_t &output) {
+	if(!node || !IS_CLASS(node, Start)) return false;
+	switch(node->ast_token) {
+	case Token::Zero:
+		output = 0;
+		return true;
+	case Token::Number: return convert_number(node->block.as_string(), output);
+	case Token::NumberHex: return convert_number_hex(node->block.as_string(), output);
+	case Token::NumberOct: return convert_number_oct(node->block.as_string(), output);
+	case Token::NumberBin: return convert_number_bin(node->block.as_string(), output);
+	default: return false;
+	}
+}
+
 struct variable_pos {
 	uint32_t up_count = 0;
 	uint32_t decl_index = 0;
 	VariableDeclaration &decl_ref;
 	bool is_closed = false;
 };
+struct InlineFrame {
+	const ASTNode *site;
+	const ASTNode *function;
+	FrameContext *callee;
+};
 struct WalkContext {
 	std::ostream &dbg;
 	std::ostream &err;
 	ModuleContext &module_ctx;
 	uint32_t current_frame_index;
 	bool pass2;
+	// call sites chosen for inlining during pass 1
+	std::unordered_set<const ASTNode*> inline_sites;
+	// names declared more than once share a slot, the body bound by the
+	// first declaration is not always the one a call sees, so never inline them
+	std::unordered_set<size_t> redeclared_names;
+	std::vector<InlineFrame> inline_stack;
+	static constexpr size_t inline_node_limit = 24;
+	// type inference: the static type of the value in the accumulator,
+	// pass 2 repeats until no variable type changes
+	VarType result_type;
+	bool types_changed;
+	std::vector<size_t> region_stack;
+	size_t next_region;
+	static constexpr size_t type_iteration_limit = 8;
 	WalkContext(std::ostream &debug_stream, std::ostream &error_stream, ModuleContext &module)
 		: dbg{debug_stream}, err{error_stream}, module_ctx{module},
-			pass2{false}, current_frame_index{1}
+			pass2{false}, current_frame_index{1},
+			result_type{VarType::Unset}, types_changed{false}, region_stack{0}, next_region{1}
 	{}
+	void for_each_declaration(auto f) {
+		for(auto &frame : module_ctx.frames) {
+			for(auto &decl : frame->closed_declarations) f(decl);
+			for(auto &decl : frame->var_declarations) f(decl);
+			for(auto &decl : frame->arg_declarations) f(decl);
+		}
+	}
 	void pass_reset() {
 		current_frame_index = 1;
 		for(auto &frame : module_ctx.frames) {
 			frame->current_var = 0;
+			frame->current_depth = 0;
+			frame->scopes.clear();
+		}
+		for_each_declaration([](auto &decl) { decl.initialized = false; });
+		inline_stack.clear();
+		region_stack.assign(1, 0);
+		next_region = 1;
+		types_changed = false;
+	}
+	void mark_all_dynamic() {
+		for_each_declaration([](auto &decl) {
+			decl.type_seen = true;
+			decl.value_type = VarType::Unset;
+		});
+	}
+	// code that may run zero times gets its own region,
+	// variables initialized in a region are only typed while inside it
+	void begin_region() {
+		region_stack.push_back(next_region++);
+	}
+	void end_region() {
+		region_stack.pop_back();
+	}
+	VarType read_type(const VariableDeclaration &decl) const {
+		if(!decl.initialized || !decl.type_seen) return VarType::Unset;
+		if(std::ranges::find(region_stack, decl.init_region) == region_stack.cend())
+			return VarType::Unset;
+		return decl.value_type;
+	}
+	void assign_type(VariableDeclaration &decl, VarType t) {
+		if(!pass2) return;
+		if(decl.merge_type(t)) types_changed = true;
+	}
+	void init_type(VariableDeclaration &decl, VarType t) {
+		if(!pass2) return;
+		if(!decl.initialized) {
+			decl.initialized = true;
+			decl.init_region = region_stack.back();
 		}
+		assign_type(decl, t);
 	}
 	bool pass1() {
 		return !pass2;
@@ -1362,6 +1895,74 @@ struct WalkContext {
 		_DW(err) << "variable not found: " << module_ctx.string_table[string_index] << "\n";
 		return std::optional<variable_pos>();
 	};
+	VariableDeclaration *find_declaration(FrameContext *search_context, const size_t string_index) {
+		// same search as get_var_ref, without closing over anything
+		while(search_context != nullptr) {
+			auto found = std::ranges::find(search_context->var_declarations, string_index, &VariableDeclaration::name_index);
+			if(found != search_context->var_declarations.end()) return &*found;
+			found = std::ranges::find_if(search_context->closed_declarations, [&](const auto &v) { return !v.is_arg && v.name_index == string_index; });
+			if(found != search_context->closed_declarations.end()) return &*found;
+			search_context = search_context->up.get();
+		}
+		return nullptr;
+	}
+	bool can_inline_node(const ASTNode &node, FrameContext &callee, FrameContext &caller, size_t &count) {
+		if(++count > inline_node_limit) return false;
+		auto same_binding = [&](const ASTNode &ident) {
+			size_t string_index = module_ctx.find_or_put_string(ident.block.as_string());
+			auto callee_decl = find_declaration(&callee, string_index);
+			return callee_decl != nullptr && callee_decl == find_declaration(&caller, string_index);
+		};
+		switch(node.asc) {
+		case Expr::Start:
+			if(IS_TOKEN(&node, Ident)) return same_binding(node);
+			return true;
+		case Expr::BlockExpr:
+			if(!IS_TOKEN(&node, Block) && !IS_TOKEN(&node, Array)) return false;
+			break;
+		case Expr::KeywExpr:
+			if(!IS_TOKEN(&node, K_If) && !IS_TOKEN(&node, K_ElseIf) && !IS_TOKEN(&node, K_Else))
+				return false;
+			break;
+		case Expr::OperExpr:
+			if(IS_TOKEN(&node, O_Decl)) return false;
+			if(IS_TOKEN(&node, O_Dot)) {
+				if(!node.list.empty() || !node.slot1) return false;
+				if(node.slot2) return can_inline_node(*node.slot1, callee, caller, count);
+				// named argument of the callee
+				if(!IS_TOKEN(node.slot1, Ident)) return false;
+				size_t string_index = module_ctx.find_or_put_string(node.slot1->block.as_string());
+				return std::ranges::any_of(callee.arg_declarations, [&](const auto &a) {
+					return !a.is_closed && a.name_index == string_index;
+				});
+			}
+			break;
+		case Expr::End:
+			return true;
+		default:
+			return false;
+		}
+		if(node.slot1 && !can_inline_node(*node.slot1, callee, caller, count)) return false;
+		if(node.slot2 && !can_inline_node(*node.slot2, callee, caller, count)) return false;
+		for(auto &item : node.list) {
+			if(item && !can_inline_node(*item, callee, caller, count)) return false;
+		}
+		return true;
+	}
+	const VariableDeclaration *get_inline_callee(std::shared_ptr<FrameContext> &ctx, const ASTNode &call, size_t arg_count) {
+		// a call to a small function bound with "let", the body is spliced into the caller
+		if(!inline_stack.empty() || !IS_TOKEN(call.slot1, Ident)) return nullptr;
+		size_t string_index = module_ctx.find_or_put_string(call.slot1->block.as_string());
+		if(redeclared_names.contains(string_index)) return nullptr;
+		auto decl = find_declaration(ctx.get(), string_index);
+		if(decl == nullptr || decl->is_mut || decl->bound_function == nullptr) return nullptr;
+		if(decl->bound_frame >= module_ctx.frames.size()) return nullptr;
+		auto &callee = *module_ctx.frames[decl->bound_frame];
+		if(callee.arg_declarations.size() != arg_count) return nullptr;
+		size_t count = 0;
+		if(!can_inline_node(*decl->bound_function->slot2, callee, *ctx, count)) return nullptr;
+		return decl;
+	}
 	auto get_arg_ref(std::shared_ptr<FrameContext> &ctx, const size_t string_index) {
 		uint32_t up_count = 0;
 		uint32_t decl_index = 0;
@@ -1439,78 +2040,176 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 		}
 	};
-	auto generate_oper_expr = [&](const node_ptr &ex) -> bool {
-		switch(ex->ast_token) {
+	auto generate_oper_expr = [&](Token oper, VarType left, VarType right) -> bool {
+		// proven operand types get the unchecked opcode, otherwise the guarded one
+		bool ints = left == VarType::Integer && right == VarType::Integer;
+		bool bools = left == VarType::Bool && right == VarType::Bool;
+		auto pick = [&](Opcode proven, Opcode guarded) {
+			ins(Instruction{ints ? proven : guarded, 0});
+			walk.result_type = VarType::Integer;
+		};
+		auto pick_compare = [&](Opcode proven, Opcode guarded) {
+			ins(Instruction{ints ? proven : guarded, 0});
+			walk.result_type = VarType::Bool;
+		};
+		auto pick_logic = [&](Opcode proven, Opcode proven_bool, Opcode guarded) {
+			ins(Instruction{ints ? proven : bools ? proven_bool : guarded, 0});
+			walk.result_type = ints ? VarType::Integer : bools ? VarType::Bool : VarType::Unset;
+		};
+		switch(oper) {
 		case Token::O_Add:
-			ins(Instruction{Opcode::AddInteger, 0});
+		case Token::O_AddEq:
+			pick(Opcode::AddInteger, Opcode::Add);
+			// unless proven integer, the guarded add may be joining strings
+			if(!ints) {
+				bool strings = left == VarType::String && right == VarType::String;
+				walk.result_type = strings ? VarType::String : VarType::Unset;
+			}
 			break;
 		case Token::O_Sub:
-			ins(Instruction{Opcode::SubInteger, 0});
+		case Token::O_SubEq:
+			pick(Opcode::SubInteger, Opcode::Sub);
 			break;
 		case Token::O_Mul:
-			ins(Instruction{Opcode::MulInteger, 0});
+		case Token::O_MulEq:
+			pick(Opcode::MulInteger, Opcode::Mul);
 			break;
 		case Token::O_Div:
-			ins(Instruction{Opcode::DivInteger, 0});
+		case Token::O_DivEq:
+			pick(Opcode::DivInteger, Opcode::Div);
 			break;
 		case Token::O_Mod:
-			ins(Instruction{Opcode::ModInteger, 0});
+		case Token::O_ModEq:
+			pick(Opcode::ModInteger, Opcode::Mod);
 			break;
 		case Token::O_Power:
-			ins(Instruction{Opcode::PowInteger, 0});
+			pick(Opcode::PowInteger, Opcode::Pow);
 			break;
 		case Token::O_And:
-			ins(Instruction{Opcode::AndInteger, 0});
+		case Token::O_AndEq:
+			pick_logic(Opcode::AndInteger, Opcode::AndBool, Opcode::And);
 			break;
 		case Token::O_Or:
-			ins(Instruction{Opcode::OrInteger, 0});
+		case Token::O_OrEq:
+			pick_logic(Opcode::OrInteger, Opcode::OrBool, Opcode::Or);
 			break;
 		case Token::O_Xor:
-			ins(Instruction{Opcode::XorInteger, 0});
+		case Token::O_XorEq:
+			pick_logic(Opcode::XorInteger, Opcode::XorBool, Opcode::Xor);
 			break;
 		case Token::O_RAsh:
-			ins(Instruction{Opcode::RSHAInteger, 0});
+		case Token::O_RAshEq:
+			pick(Opcode::RSHAInteger, Opcode::RSHA);
 			break;
 		case Token::O_Rsh:
-			ins(Instruction{Opcode::RSHLInteger, 0});
+		case Token::O_RshEq:
+			pick(Opcode::RSHLInteger, Opcode::RSHL);
 			break;
 		case Token::O_Lsh:
-			ins(Instruction{Opcode::LSHInteger, 0});
+		case Token::O_LshEq:
+			pick(Opcode::LSHInteger, Opcode::LSH);
 			break;
 		case Token::O_Minus:
-			ins(Instruction{Opcode::Negate, 0});
+			ints = right == VarType::Integer;
+			pick(Opcode::NegateInteger, Opcode::Negate);
 			break;
 		case Token::O_Not:
 			ins(Instruction{Opcode::Not, 0});
+			walk.result_type = VarType::Bool;
 			break;
 		case Token::O_Less:
-			ins(Instruction{Opcode::CompareLess, 0});
+			pick_compare(Opcode::CompareLessInteger, Opcode::CompareLess);
 			break;
 		case Token::O_Greater:
-			ins(Instruction{Opcode::CompareGreater, 0});
+			pick_compare(Opcode::CompareGreaterInteger, Opcode::CompareGreater);
 			break;
 		case Token::O_EqEq:
-			ins(Instruction{Opcode::CompareEqual, 0});
+			pick_compare(Opcode::CompareEqual, Opcode::CompareEqual);
 			break;
 		case Token::O_NotEq:
-			ins(Instruction{Opcode::CompareNotEqual, 0});
+			pick_compare(Opcode::CompareNotEqual, Opcode::CompareNotEqual);
 			break;
 		case Token::O_LessEq:
-			ins(Instruction{Opcode::CompareLessEqual, 0});
+			pick_compare(Opcode::CompareLessEqualInteger, Opcode::CompareLessEqual);
 			break;
 		case Token::O_GreaterEq:
-			ins(Instruction{Opcode::CompareGreaterEqual, 0});
+			pick_compare(Opcode::CompareGreaterEqualInteger, Opcode::CompareGreaterEqual);
 			break;
 		case Token::O_Spaceship:
 			ins(Instruction{Opcode::CompareSpaceship, 0});
+			walk.result_type = VarType::Unset;
 			break;
 		default:
-			_DW(walk.err) << "unhandled operator: " << expr->ast_token << "\n";
+			_DW(walk.err) << "unhandled operator: " << oper << "\n";
 			return false;
 		}
 		return true;
 	};
+	auto generate_const_oper = [&](Token oper, VarType left, const node_ptr &right) -> bool {
+		// strength reduction for a literal right side, the left value is in the accumulator
+		uint64_t value = 0;
+		if(!literal_value(right, value)) return false;
+		// the reduced forms are integer only, check the left side unless it is proven
+		auto guard = [&]() {
+			if(left != VarType::Integer) ins(Instruction{Opcode::GuardInteger});
+			walk.result_type = VarType::Integer;
+		};
+		switch(oper) {
+		case Token::O_Mul:
+		case Token::O_MulEq:
+			guard();
+			if(!std::has_single_bit(value)) {
+				ins(Instruction{Opcode::MulConstInteger, value});
+			} else if(value > 1) {
+				ins(Instruction{Opcode::LSHConstInteger, static_cast<uint64_t>(std::countr_zero(value))});
+			}
+			return true;
+		case Token::O_Div:
+		case Token::O_DivEq:
+			if(value == 0) return false;
+			guard();
+			if(!std::has_single_bit(value)) {
+				ins(Instruction{Opcode::DivMagicInteger, walk.module_ctx.find_or_put_divisor(value)});
+			} else if(value > 1) {
+				ins(Instruction{Opcode::RSHLConstInteger, static_cast<uint64_t>(std::countr_zero(value))});
+			}
+			return true;
+		case Token::O_Mod:
+		case Token::O_ModEq:
+			if(value == 0) return false;
+			guard();
+			if(!std::has_single_bit(value)) {
+				ins(Instruction{Opcode::ModMagicInteger, walk.module_ctx.find_or_put_divisor(value)});
+			} else {
+				ins(Instruction{Opcode::AndConstInteger, value - 1});
+			}
+			return true;
+		case Token::O_Power:
+			if(value > 255) return false;
+			guard();
+			if(value == 0) {
+				ins(Instruction{Opcode::LoadConst, 1});
+				return true;
+			}
+			if(std::has_single_bit(value)) {
+				for(int squares = std::countr_zero(value); squares > 0; squares--)
+					ins(Instruction{Opcode::SquareInteger});
+				return true;
+			}
+			// square and multiply from the top bit down, the base stays on the stack
+			ins(Instruction{Opcode::PushRegister, 0});
+			for(int bit = std::bit_width(value) - 2; bit >= 0; bit--) {
+				ins(Instruction{Opcode::SquareInteger});
+				if((value >> bit) & 1) ins(Instruction{Opcode::MulStackInteger});
+			}
+			ins(Instruction{Opcode::PopStack, 0});
+			return true;
+		default:
+			return false;
+		}
+	};
 	_DW(walk.dbg) << "Expr:" << expr->ast_token << " ";
+	walk.result_type = VarType::Unset;
 	switch(expr->asc) {
 	case Expr::BlockExpr: {
 		if(IS_TOKEN(expr, Array)) {
@@ -1536,9 +2235,40 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			end_scope();
 			ins(Instruction{Opcode::LoadNewArray, stack_size});
+			walk.result_type = VarType::Array;
 			break;
 		}
 		if(IS_TOKEN(expr, Object)) {
+			// plain members with distinct names: push the values,
+			// then build the object from a template in one step
+			std::vector<size_t> names;
+			bool plain = true;
+			for(auto &walk_node : expr->list) {
+				if(!IS_TOKEN(walk_node, O_Assign) && !IS_TOKEN(walk_node, O_ObjAssign)) {
+					plain = false;
+					break;
+				}
+				size_t name_index =
+					walk.module_ctx.find_or_put_string(walk_node->slot1->block.as_string());
+				if(std::ranges::find(names, name_index) != names.cend()) {
+					plain = false;
+					break;
+				}
+				names.push_back(name_index);
+			}
+			if(plain) {
+				begin_scope();
+				_DW(walk.err) << "object template: " << expr->ast_token << '\n';
+				for(auto &walk_node : expr->list) {
+					if(!walk_expression(walk, ctx, walk_node->slot2)) return false;
+					ins(Instruction{Opcode::PushRegister});
+				}
+				end_scope();
+				ins(Instruction{Opcode::NewObjectFromTemplate,
+					walk.module_ctx.find_or_put_template(std::move(names))});
+				walk.result_type = VarType::Object;
+				break;
+			}
 			ins(Instruction{Opcode::LoadNewObject});
 			ins(Instruction{Opcode::PushRegister});
 			begin_scope();
@@ -1554,6 +2284,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			end_scope();
 			ins(Instruction{Opcode::PopRegister});
+			walk.result_type = VarType::Object;
 			break;
 		}
 		begin_scope();
@@ -1568,6 +2299,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 		} else if(IS_TOKEN(expr, DotArray)) {
 			_DW(walk.dbg) << "argument lookup end\n";
 			ins(Instruction{Opcode::NamedArgLookup});
+			walk.result_type = VarType::Unset;
 			break;
 		}
 		_DW(walk.err) << "unhandled block type: " << expr->ast_token << '\n';
@@ -1597,11 +2329,16 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 				return false;
 			}
 			size_t string_index = walk.module_ctx.find_or_put_string(id);
+			size_t function_frame = walk.current_frame_index;
 			if(expr->slot2) {
 				if(!walk_expression(walk, ctx, expr->slot2)) return false;
 			}
 			if(walk.pass1()) {
 				ctx->var_declarations.emplace_back(VariableDeclaration{ string_index, false, is_mutable });
+				if(expr->slot2 && IS_CLASS(expr->slot2, FuncExpr)) {
+					ctx->var_declarations.back().bound_function = expr->slot2.get();
+					ctx->var_declarations.back().bound_frame = function_frame;
+				}
 				ctx->current_var++;
 				ctx->current_depth++;
 			} else {
@@ -1611,6 +2348,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 					ctx->current_var++;
 					ctx->current_depth++;
 				}
+				walk.init_type(var_ref->decl_ref, walk.result_type);
 				if(expr->slot2) {
 					// assign the value
 					_DW(walk.err) << "let decl " << var_ref->decl_ref << " " << str_table(string_index) << " = \n";
@@ -1625,7 +2363,12 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			if(!walk_expression(walk, ctx, expr->slot1)) return false;
 			size_t skip_pos = ctx->instructions.size();
 			ins(Instruction{Opcode::JumpElse, 0});
+			walk.begin_region();
 			if(!walk_expression(walk, ctx, expr->slot2)) return false;
+			walk.end_region();
+			// the value of the "if" has a type only when every branch agrees
+			VarType branch_type = walk.result_type;
+			bool has_else = false;
 			std::vector<size_t> exit_positions;
 			bool hanging_elseif = false;
 			auto walk_expr = expr->list.cbegin();
@@ -1646,11 +2389,14 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 						ctx->instructions[skip_pos].param = ctx->instructions.size();
 					}
 					// test expression
+					walk.begin_region();
 					if(!walk_expression(walk, ctx, (*walk_expr)->slot1)) return false;
 					skip_pos = ctx->instructions.size();
 					hanging_elseif = true; // "else" jump exits if no more branches
 					ins(Instruction{Opcode::JumpElse, 0});
 					if(!walk_expression(walk, ctx, (*walk_expr)->slot2)) return false;
+					walk.end_region();
+					if(walk.result_type != branch_type) branch_type = VarType::Unset;
 				} else if(IS_TOKEN((*walk_expr), K_Else)) {
 					if((*walk_expr)->open()) {
 						walk.show_syn_error("Else", *walk_expr);
@@ -1664,7 +2410,11 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 						// fixup the previous test's "else" jump
 						ctx->instructions[skip_pos].param = ctx->instructions.size();
 					}
+					walk.begin_region();
 					if(!walk_expression(walk, ctx, (*walk_expr)->slot1)) return false;
+					walk.end_region();
+					if(walk.result_type != branch_type) branch_type = VarType::Unset;
+					has_else = true;
 					break;
 				} else {
 					walk.show_syn_error("If-Else", *walk_expr);
@@ -1680,20 +2430,25 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 					ctx->instructions[pos].param = exit_point;
 				}
 			}
+			walk.result_type = has_else ? branch_type : VarType::Unset;
 			return true;
 		}
 		case Token::K_End: {
 			if(!walk_expression(walk, ctx, expr->slot1)) return false;
 			ins(Instruction{Opcode::ExitFunction, 0});
+			walk.result_type = VarType::Unset;
 			return true;
 		}
 		case Token::K_Loop: {
 			auto &inner_expr = expr->slot1;
 			size_t loop_point = ctx->instructions.size();
 			begin_loop_scope(loop_point);
+			walk.begin_region();
 			if(!walk_expression(walk, ctx, inner_expr)) return false;
+			walk.end_region();
 			ins(Instruction{Opcode::Jump, loop_point});
 			end_scope();
+			walk.result_type = VarType::Unset;
 			return true;
 		}
 		case Token::K_Break: {
@@ -1708,6 +2463,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 				found->loop->exit_points.push_back(ctx->instructions.size());
 				ins(Instruction{Opcode::Jump, 0});
 			}
+			walk.result_type = VarType::Unset;
 			return true;
 		}
 		case Token::K_Continue: {
@@ -1731,7 +2487,9 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			if(IS_TOKEN(expr, K_While)) // don't jump to exit
 				ins(Instruction{Opcode::JumpElse, 0});
 			else ins(Instruction{Opcode::JumpIf, 0});
+			walk.begin_region();
 			if(!walk_expression(walk, ctx, expr->slot2)) return false;
+			walk.end_region();
 			if(walk.pass2) {
 				_DW(walk.dbg) << "end " << expr->ast_token
 					<< " jump_pos=" << ctx->instructions.size()
@@ -1741,6 +2499,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			end_scope();
 			// for(auto &ins : ctx->instructions) _DW(walk.dbg) << ins << '\n';
+			walk.result_type = VarType::Unset;
 			return true;
 		}
 		default:
@@ -1765,11 +2524,65 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 				walk.show_syn_error("Function call", expr);
 				return false;
 			}
+			auto &args = expr->slot2;
+			bool inline_call = false;
+			std::vector<const node_ptr*> inline_args;
+			if(walk.inline_stack.empty() && IS_TOKEN(args, Block)) {
+				if(args->list.size() == 1 && IS_CLASS(args->list.front(), OperExpr)
+						&& IS_TOKEN(args->list.front(), Comma)) {
+					for(auto &comma_arg : args->list.front()->list) inline_args.push_back(&comma_arg);
+				} else {
+					for(auto &arg : args->list) inline_args.push_back(&arg);
+				}
+				if(walk.pass1()) {
+					inline_call = walk.get_inline_callee(ctx, *expr, inline_args.size()) != nullptr;
+					if(inline_call) walk.inline_sites.insert(expr.get());
+				} else {
+					inline_call = walk.inline_sites.contains(expr.get());
+				}
+			}
+			if(inline_call) {
+				// splice the callee body in, arguments are stored to hidden locals
+				auto callee_decl = walk.find_declaration(ctx.get(),
+					walk.module_ctx.find_or_put_string(expr->slot1->block.as_string()));
+				if(callee_decl == nullptr) return false;
+				auto function = callee_decl->bound_function;
+				auto callee = walk.module_ctx.frames[callee_decl->bound_frame].get();
+				_DW(walk.dbg) << "inline call to frame " << callee->frame_index << ": ";
+				for(size_t arg_index = 0; arg_index < inline_args.size(); arg_index++) {
+					if(!walk_expression(walk, ctx, *inline_args[arg_index])) return false;
+					if(walk.pass1()) {
+						VariableDeclaration hidden{0, false};
+						hidden.inline_site = expr.get();
+						hidden.inline_arg = arg_index;
+						ctx->var_declarations.emplace_back(hidden);
+					} else {
+						auto hidden = std::ranges::find_if(ctx->var_declarations, [&](const auto &v) {
+							return v.inline_site == expr.get() && v.inline_arg == arg_index;
+						});
+						if(hidden == ctx->var_declarations.cend()) return false;
+						walk.init_type(*hidden, walk.result_type);
+						ins(Instruction{Opcode::StoreLocal, 0,
+							static_cast<uint32_t>(hidden - ctx->var_declarations.cbegin())});
+					}
+				}
+				walk.inline_stack.push_back(InlineFrame{expr.get(), function, callee});
+				bool walked = true;
+				if(IS_TOKEN(function->slot2, Block)) {
+					for(auto &walk_node : function->slot2->list) {
+						if(!(walked = walk_expression(walk, ctx, walk_node))) break;
+					}
+				} else {
+					walked = walk_expression(walk, ctx, function->slot2);
+				}
+				walk.inline_stack.pop_back();
+				_DW(walk.dbg) << "\n";
+				return walked;
+			}
 			_DW(walk.dbg) << "reference: ";
 			if(!walk_expression(walk, ctx, expr->slot1)) return false;
 			_DW(walk.dbg) << "\ncall with: ";
 			// arguments
-			auto &args = expr->slot2;
 			bool func_save = false;
 			size_t arg_count = 0;
 			if(IS_TOKEN(args, Block) && args->list.empty()) {
@@ -1810,13 +2623,14 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			if(func_save) arg_count++;
 			if(arg_count > 0) ins(Instruction{Opcode::PopStack, arg_count - 1});
 			_DW(walk.dbg) << "\n";
+			walk.result_type = VarType::Unset;
 			return true;
 		} else if(IS_TOKEN(expr, O_Dot) && expr->slots == ASTSlots::NONE) {
 			_DW(walk.dbg) << "Load primary argument(s) operator" << '\n';
 			if(walk.pass1() && ctx->arg_declarations.empty()) {
 				ctx->arg_declarations.emplace_back(VariableDeclaration{0, true});
 			}
-			ins(Instruction{Opcode::LoadLocal, 0, 0});
+			ins(Instruction{Opcode::LoadArg, 0, 0});
 			return true;
 		}
 		_DW(walk.dbg) << "operator: " << expr->ast_token;
@@ -1827,6 +2641,24 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			auto arg_string = expr->slot1->block.as_string();
 			size_t string_index = walk.module_ctx.find_or_put_string(arg_string);
+			if(!walk.inline_stack.empty()) {
+				// argument of an inlined function, read back the hidden local
+				auto &inlined = walk.inline_stack.back();
+				auto &callee_args = inlined.callee->arg_declarations;
+				auto arg_itr = std::ranges::find(callee_args, string_index, &VariableDeclaration::name_index);
+				size_t arg_index = arg_itr - callee_args.cbegin();
+				auto hidden = std::ranges::find_if(ctx->var_declarations, [&](const auto &v) {
+					return v.inline_site == inlined.site && v.inline_arg == arg_index;
+				});
+				if(hidden == ctx->var_declarations.cend()) {
+					_DW(walk.err) << "inlined argument not found: " << arg_string << '\n';
+					return false;
+				}
+				ins(Instruction{Opcode::LoadLocal, 0,
+					static_cast<uint32_t>(hidden - ctx->var_declarations.cbegin())});
+				walk.result_type = walk.read_type(*hidden);
+				return true;
+			}
 			_DW(walk.dbg) << "CTX:" << ctx << '\n';
 			auto var_pos = walk.get_arg_ref(ctx, string_index);
 			if(!var_pos.has_value()) return false;
@@ -1847,6 +2679,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 					return false;
 				}
 				if(!walk_expression(walk, ctx, right_ref)) return false;
+				walk.assign_type(var_pos->decl_ref, walk.result_type);
 				ins(Instruction{
 					var_pos->is_closed ? Opcode::StoreVariable : Opcode::StoreLocal,
 					var_pos->up_count, var_pos->decl_index});
@@ -1901,48 +2734,16 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 					str_table(string_index) << "->"
 					<< var_pos->up_count << ","
 					<< var_pos->decl_index << "\n";
-				ins(Instruction{Opcode::PushRegister, 0});
-				if(!walk_expression(walk, ctx, right_ref)) return false;
-				switch(expr->ast_token) {
-				case Token::O_AndEq:
-					ins(Instruction{Opcode::AndInteger, 0});
-					break;
-				case Token::O_OrEq:
-					ins(Instruction{Opcode::OrInteger, 0});
-					break;
-				case Token::O_XorEq:
-					ins(Instruction{Opcode::XorInteger, 0});
-					break;
-				case Token::O_AddEq:
-					ins(Instruction{Opcode::AddInteger, 0});
-					break;
-				case Token::O_SubEq:
-					ins(Instruction{Opcode::SubInteger, 0});
-					break;
-				case Token::O_MulEq:
-					ins(Instruction{Opcode::MulInteger, 0});
-					break;
-					//ins(Instruction{Opcode::PowInteger, 0});
-				case Token::O_DivEq:
-					ins(Instruction{Opcode::DivInteger, 0});
-					break;
-				case Token::O_ModEq:
-					ins(Instruction{Opcode::ModInteger, 0});
-					break;
-				case Token::O_LshEq:
-					ins(Instruction{Opcode::LSHInteger, 0});
-					break;
-				case Token::O_RAshEq:
-					ins(Instruction{Opcode::RSHAInteger, 0});
-					break;
-				case Token::O_RshEq:
-					ins(Instruction{Opcode::RSHLInteger, 0});
-					break;
-				default:
-					_DW(walk.err) << "unhandled assign operator: " << expr->ast_token << '\n';
-					return false;
+				VarType left_type = walk.read_type(var_pos->decl_ref);
+				if(!generate_const_oper(expr->ast_token, left_type, right_ref)) {
+					ins(Instruction{Opcode::PushRegister, 0});
+					if(!walk_expression(walk, ctx, right_ref)) return false;
+					if(!generate_oper_expr(expr->ast_token, left_type, walk.result_type)) return false;
 				}
-				ins(Instruction{Opcode::StoreVariable, var_pos.value().up_count, var_pos.value().decl_index});
+				walk.assign_type(var_pos->decl_ref, walk.result_type);
+				ins(Instruction{
+					var_pos->is_closed ? Opcode::StoreVariable : Opcode::StoreLocal,
+					var_pos.value().up_count, var_pos.value().decl_index});
 				_DW(walk.dbg) << "store variable [" << string_index << "]" <<
 					str_table(string_index) << "->"
 					<< var_pos.value().up_count << ","
@@ -1963,12 +2764,15 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 				size_t string_index = walk.module_ctx.find_or_put_string(
 					expr->slot2->block.as_string() );
 				ins(Instruction{Opcode::NamedLookup, string_index});
+				walk.result_type = VarType::Unset;
 				return true;
 			}
+			VarType left_type = walk.result_type;
+			if(generate_const_oper(expr->ast_token, left_type, expr->slot2)) return true;
 			_DW(walk.dbg) << "\nexpr R: ";
 			ins(Instruction{Opcode::PushRegister, 0});
 			if(!walk_expression(walk, ctx, expr->slot2)) return false;
-			if(!generate_oper_expr(expr)) return false;
+			if(!generate_oper_expr(expr->ast_token, left_type, walk.result_type)) return false;
 			return true;
 		} else if(expr->list.size() > 0) {
 			// handle below
@@ -1984,10 +2788,15 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			expr_itr++;
 		}
 		while(expr_itr != expr_end) {
+			VarType left_type = walk.result_type;
+			if(generate_const_oper(expr->ast_token, left_type, *expr_itr)) {
+				expr_itr++;
+				continue;
+			}
 			_DW(walk.dbg) << "\nexpr I: ";
 			ins(Instruction{Opcode::PushRegister, 0});
 			if(!walk_expression(walk, ctx, *expr_itr)) return false;
-			if(!generate_oper_expr(expr)) return false;
+			if(!generate_oper_expr(expr->ast_token, left_type, walk.result_type)) return false;
 			expr_itr++;
 		}
 		return true;
@@ -1996,6 +2805,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 		switch(expr->ast_token) {
 		case Token::Zero:
 			ins(Instruction{Opcode::LoadConst, 0});
+			walk.result_type = VarType::Integer;
 			return true;
 		case Token::Number: {
 			uint64_t value = 0;
@@ -2005,6 +2815,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			_DW(walk.dbg) << "number value: " << value << "\n";
 			ins(Instruction{Opcode::LoadConst, value});
+			walk.result_type = VarType::Integer;
 			return true;
 		}
 		case Token::NumberHex: {
@@ -2015,6 +2826,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			_DW(walk.dbg) << "number value: " << value << " from " << expr->block.as_string() << "\n";
 			ins(Instruction{Opcode::LoadConst, value});
+			walk.result_type = VarType::Integer;
 			return true;
 		}
 		case Token::NumberOct: {
@@ -2025,6 +2837,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			_DW(walk.dbg) << "number value: " << value << " from " << expr->block.as_string() << "\n";
 			ins(Instruction{Opcode::LoadConst, value});
+			walk.result_type = VarType::Integer;
 			return true;
 		}
 		case Token::NumberBin: {
@@ -2035,13 +2848,16 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			_DW(walk.dbg) << "number value: " << value << " from " << expr->block.as_string() << "\n";
 			ins(Instruction{Opcode::LoadConst, value});
+			walk.result_type = VarType::Integer;
 			return true;
 		}
 		case Token::K_True:
 			ins(Instruction{Opcode::LoadBool, 1});
+			walk.result_type = VarType::Bool;
 			return true;
 		case Token::K_False:
 			ins(Instruction{Opcode::LoadBool, 0});
+			walk.result_type = VarType::Bool;
 			return true;
 		case Token::Ident: {
 			auto string_index = walk.module_ctx.find_or_put_string(expr->block.as_string());
@@ -2060,6 +2876,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 				expr->block.as_string() << "->"
 				<< var_pos->up_count << ","
 				<< var_pos->decl_index << "\n";
+			walk.result_type = walk.read_type(var_pos->decl_ref);
 			return true;
 		}
 		case Token::String: {
@@ -2072,6 +2889,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 			}
 			size_t string_index = walk.module_ctx.find_or_put_string(s);
 			ins(Instruction{Opcode::LoadString, string_index});
+			walk.result_type = VarType::String;
 			return true;
 		}
 		default:
@@ -2131,6 +2949,7 @@ bool walk_expression(WalkContext &walk, std::shared_ptr<FrameContext> &ctx, cons
 				return false;
 		}
 		_DW(walk.dbg) << "function end\n";
+		walk.result_type = VarType::Function;
 		break;
 	}
 	default:
@@ -2851,6 +3670,7 @@ bool parse_source(std::ostream &dbg, std::shared_ptr<ModuleContext> root_module)
 		}
 	};
 	auto collapse_expr = [&](bool terminating, Expr down_to = Expr::End) {
+		PhaseTimer collapse_timer{root_module->stats.collapse_ns};
 		auto &expr_list = current_block->expr_list;
 		// try to collapse the expression list
 		CollapseContext ctx { dbg, current_block, expr_hold, terminating, down_to, false, false };
@@ -3110,6 +3930,7 @@ bool parse_source(std::ostream &dbg, std::shared_ptr<ModuleContext> root_module)
 		size_t tk_end = cursor - file_start;
 		auto original = current_token;
 		auto range = LexTokenRange{token_start, cursor, current_token};
+		root_module->stats.tokens++;
 		//_DL(dbg) << "TK:" << tk_start << "," << tk_end << ":" << current_token << "\n";
 		if(push_token(range)) {
 			//if(!token_buffer.empty()) parsed = token_buffer.back().token;
@@ -3248,10 +4069,14 @@ void show_lines(std::ostream &out, const ModuleContext &module) {
 void show_scopes(std::ostream &out, const ModuleContext &module) {
 	out << "\nScopes:\n";
 	for(auto scope = module.frames.cbegin(); scope != module.frames.cend(); scope++) {
-		out << "Scope: " << scope - module.frames.cbegin() << "\n";
-		auto ins_begin = (*scope)->instructions.cbegin();
-		for(auto ins = ins_begin; ins != (*scope)->instructions.cend(); ins++)
-			out << "[" << ins - ins_begin << "] " << *ins << '\n';
+		out << "Scope: " << scope - module.frames.cbegin() << " max_stack: " << (*scope)->max_stack << "\n";
+		auto &code = (*scope)->code;
+		for(const uint32_t *pc = code.data(); pc != code.data() + code.size();) {
+			Instruction ins{Opcode::LoadUnit};
+			out << "[" << pc - code.data() << "] ";
+			pc = decode_instruction(pc, ins);
+			out << ins << '\n';
+		}
 	}
 }
 
@@ -3268,93 +4093,872 @@ module_ptr test_parse_sourcefile(std::ostream &dbg, const string_view file_path)
 ModuleSource& get_source(const module_ptr &module) {
 	return module->source;
 }
+static void timed_parse(std::ostream &dbg, module_ptr &root_module) {
+	auto &stats = root_module->stats;
+	{
+		PhaseTimer timer{stats.lex_ns};
+		parse_source(dbg, root_module);
+	}
+	// collapse_expr runs interleaved with the lexer
+	stats.lex_ns -= std::min(stats.lex_ns, stats.collapse_ns);
+}
+static void collect_redeclared_names(WalkContext &walk, const ASTNode *node, std::unordered_set<size_t> &declared) {
+	if(!node) return;
+	if(IS_TOKEN(node, K_Let) || IS_TOKEN(node, K_Mut)) {
+		// same name forms as the let handler in walk_expression
+		auto item = node->slot1.get();
+		if(item && IS_TOKEN(item, K_Mut) && !item->empty()) item = item->slot1.get();
+		const ASTNode *ident = nullptr;
+		if(item && IS_TOKEN(item, O_Decl) && item->slot1 && IS_TOKEN(item->slot1, Ident)) ident = item->slot1.get();
+		else if(item && IS_TOKEN(item, Ident)) ident = item;
+		if(ident) {
+			size_t string_index = walk.module_ctx.find_or_put_string(ident->block.as_string());
+			if(!declared.insert(string_index).second) walk.redeclared_names.insert(string_index);
+		}
+	}
+	collect_redeclared_names(walk, node->slot1.get(), declared);
+	collect_redeclared_names(walk, node->slot2.get(), declared);
+	for(auto &item : node->list) collect_redeclared_names(walk, item.get(), declared);
+}
+static bool walk_first_pass(WalkContext &walk, module_ptr &root_module) {
+	PhaseTimer timer{root_module->stats.pass1_ns};
+	{
+		std::unordered_set<size_t> declared;
+		collect_redeclared_names(walk, root_module->source.root_tree.get(), declared);
+	}
+	return walk_expression(walk, root_module->root_context, root_module->source.root_tree);
+}
+static bool walk_code_pass(WalkContext &walk, module_ptr &root_module) {
+	PhaseTimer timer{root_module->stats.pass2_ns};
+	// the code pass repeats while variable types are still widening,
+	// with a cap after which every variable is treated as dynamic
+	for(size_t iteration = 0;; iteration++) {
+		root_module->stats.code_passes++;
+		walk.pass_reset();
+		walk.pass2 = true;
+		for(auto &frame : root_module->frames) frame->instructions.clear();
+		if(iteration == walk.type_iteration_limit) walk.mark_all_dynamic();
+		if(!walk_expression(walk, root_module->root_context, root_module->source.root_tree)) return false;
+		if(!walk.types_changed || iteration == walk.type_iteration_limit) break;
+	}
+	for(auto &frame : root_module->frames) {
+		frame->max_stack = check_operand_stack(frame->instructions, root_module->object_templates).max_depth;
+		frame->code = encode_code(frame->instructions);
+		frame->instructions.clear();
+		frame->instructions.shrink_to_fit();
+	}
+	return true;
+}
+static size_t count_nodes(const ASTNode *node) {
+	if(!node) return 0;
+	size_t count = 1 + count_nodes(node->slot1.get()) + count_nodes(node->slot2.get());
+	for(auto &item : node->list) count += count_nodes(item.get());
+	return count;
+}
+static void count_module_stats(ModuleContext &module) {
+	auto &stats = module.stats;
+	stats.ast_nodes = count_nodes(module.source.root_tree.get());
+	stats.frames = module.frames.size();
+	stats.strings = module.string_table.size();
+	stats.instructions = 0;
+	stats.string_bytes = 0;
+	uint64_t bytes = module.source.source.size()
+		+ stats.tokens * sizeof(LexTokenRange)
+		+ stats.ast_nodes * sizeof(ASTNode)
+		+ module.line_positions.size() * sizeof(size_t)
+		+ module.string_table.size() * sizeof(std::string_view)
+		+ module.divisor_table.size() * sizeof(DivisorMagic);
+	for(auto &str : module.string_table) stats.string_bytes += str.size();
+	for(auto &tpl : module.object_templates) bytes += sizeof(ObjectTemplate) + tpl.names.size() * sizeof(size_t);
+	for(auto &frame : module.frames) {
+		for(const uint32_t *pc = frame->code.data(); pc != frame->code.data() + frame->code.size();) {
+			Instruction ins{Opcode::LoadUnit};
+			pc = decode_instruction(pc, ins);
+			stats.instructions++;
+		}
+		bytes += sizeof(FrameContext)
+			+ frame->code.size() * sizeof(uint32_t)
+			+ (frame->closed_declarations.size() + frame->var_declarations.size()
+				+ frame->arg_declarations.size()) * sizeof(VariableDeclaration);
+	}
+	stats.bytes_allocated = bytes;
+}
+const CompileStats& get_compile_stats(const module_ptr &module) {
+	return module->stats;
+}
+void show_compile_stats(std::ostream &out, const CompileStats &stats) {
+	out << "lex_ns=" << stats.lex_ns << '\n'
+		<< "collapse_ns=" << stats.collapse_ns << '\n'
+		<< "pass1_ns=" << stats.pass1_ns << '\n'
+		<< "pass2_ns=" << stats.pass2_ns << '\n'
+		<< "load_ns=" << stats.load_ns << '\n'
+		<< "code_passes=" << stats.code_passes << '\n'
+		<< "tokens=" << stats.tokens << '\n'
+		<< "ast_nodes=" << stats.ast_nodes << '\n'
+		<< "bytes_allocated=" << stats.bytes_allocated << '\n'
+		<< "frames=" << stats.frames << '\n'
+		<< "instructions=" << stats.instructions << '\n'
+		<< "strings=" << stats.strings << '\n'
+		<< "string_bytes=" << stats.string_bytes << '\n';
+}
+void show_gc_stats(std::ostream &out, const GcStats &stats) {
+	out << "collections=" << stats.collections << '\n'
+		<< "objects_freed=" << stats.objects_freed << '\n'
+		<< "bytes_freed=" << stats.bytes_freed << '\n'
+		<< "live_objects=" << stats.live_objects << '\n'
+		<< "live_bytes=" << stats.live_bytes << '\n'
+		<< "total_ns=" << stats.total_ns << '\n'
+		<< "max_pause_ns=" << stats.max_pause_ns << '\n';
+	for(size_t bucket = 0; bucket < gc_pause_buckets; bucket++) {
+		if(!stats.pause_histogram[bucket]) continue;
+		out << "pauses_below_ns_" << (uint64_t{1} << bucket) << '=' << stats.pause_histogram[bucket] << '\n';
+	}
+}
 module_ptr compile_sourcefile(std::ostream &out, string file_source) {
 	module_ptr root_module = std::make_shared<ModuleContext>(std::move(file_source));
-	parse_source(out, root_module);
+	timed_parse(out, root_module);
 	auto walk = WalkContext{out, out, *root_module.get()};
 	root_module->add_import("sys");
 	root_module->add_import("io");
-	walk_expression(walk, root_module->root_context, root_module->source.root_tree);
-	walk.pass_reset();
-	walk.pass2 = true;
-	walk_expression(walk, root_module->root_context, root_module->source.root_tree);
+	// the code of a failed walk stops partway, with jumps left unpatched
+	if(!walk_first_pass(walk, root_module) || !walk_code_pass(walk, root_module)) return nullptr;
+	count_module_stats(*root_module);
 	return root_module;
 }
 module_ptr test_compile_sourcefile(std::ostream &dbg, const string_view file_path) {
 	std::string file_source;
 	if(!LoadFileV(file_path, file_source)) return nullptr;
 	module_ptr root_module = std::make_shared<ModuleContext>(std::move(file_source));
-	parse_source(dbg, root_module);
+	timed_parse(dbg, root_module);
 	show_source_tree(dbg, root_module->source);
 	auto walk = WalkContext{dbg, dbg, *root_module.get()};
 	dbg << "^ Complete:\n";
 	root_module->add_import("sys");
 	root_module->add_import("io");
-	walk_expression(walk, root_module->root_context, root_module->source.root_tree);
-	walk.pass_reset();
-	walk.pass2 = true;
+	if(!walk_first_pass(walk, root_module)) return nullptr;
 	dbg << "^ Pass 2:\n";
-	walk_expression(walk, root_module->root_context, root_module->source.root_tree);
+	if(!walk_code_pass(walk, root_module)) return nullptr;
+	count_module_stats(*root_module);
 	dbg << "^ Result:\n";
 	show_string_table(dbg, *root_module);
 	show_scopes(dbg, *root_module);
 	return root_module;
 }
 
-struct StackFrame;
-struct UpScope {
-	std::shared_ptr<UpScope> up;
-	std::vector<Register> vars;
-};
-struct VMFunction : VMVar {
-	std::shared_ptr<UpScope> up;
-	size_t scope_id;
-	VMFunction(std::shared_ptr<UpScope> _up, size_t _id)
-		: up{_up}, scope_id{_id} {}
-	VarType get_type() const { return VarType::Function; }
-};
-struct VMArray : VMVar {
-	std::vector<Register> values;
-	VMArray() {}
-	VarType get_type() const { return VarType::Array; }
-};
-struct VMObject : VMVar {
-	std::unordered_map<size_t, Register> values;
-	VMObject() {}
-	VarType get_type() const { return VarType::Object; }
-};
-struct StackFrame {
-	std::shared_ptr<FrameContext> context;
-	std::shared_ptr<UpScope> scope;
-	std::vector<Instruction>::const_iterator current_instruction;
-	size_t first_arg_pos;
-	size_t first_var_pos;
-	StackFrame(
-		std::shared_ptr<FrameContext> ctx,
-		std::shared_ptr<UpScope> up_ptr)
-		: scope{std::make_shared<UpScope>(UpScope{up_ptr})}, context{ctx},
-		first_arg_pos{0}, first_var_pos{0} { }
-};
+// bytecode image (.ffc)
+// all fields are 64 bit host order words, strings are stored once after the word sections.
+// the header is magic, version, opcode signature and a checksum of everything after it
+constexpr char module_image_magic[8] = {'F', 'a', 'e', 'C', 'o', 'd', 'e', '\0'};
+constexpr uint64_t module_image_version = 5;
+constexpr size_t module_image_header_words = 4;
+static uint64_t fnv1a_hash(const char *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+	for(size_t i = 0; i < size; i++) hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3ull;
+	return hash;
+}
+static uint64_t opcode_set_signature() {
+	// images only load into a VM with the same opcode numbering
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for(auto name : opcode_names_span) {
+		hash = fnv1a_hash(name.data(), name.size(), hash);
+		hash = (hash ^ 0xff) * 0x100000001b3ull;
+	}
+	return hash;
+}
+enum class DeclFlags : uint64_t { None = 0, Closed = 1, Arg = 2, Mut = 4 };
+bool write_module_image(std::ostream &out, const ModuleContext &module) {
+	std::vector<uint64_t> words;
+	auto put = [&](uint64_t v) { words.push_back(v); };
+	std::string string_data;
+	uint64_t magic_word = 0;
+	std::copy_n(module_image_magic, sizeof(magic_word), reinterpret_cast<char*>(&magic_word));
+	put(magic_word);
+	put(module_image_version);
+	put(opcode_set_signature());
+	put(0); // checksum, filled in below
+	put(module.string_table.size());
+	for(auto str : module.string_table) {
+		put(string_data.size());
+		put(str.size());
+		string_data.append(str);
+	}
+	put(module.imports.size());
+	for(auto &import_ptr : module.imports) {
+		auto found = std::ranges::find(module.string_table, string_view(import_ptr->var_name));
+		if(found == module.string_table.cend()) return false;
+		put(found - module.string_table.cbegin());
+		put(import_ptr->pos);
+	}
+	put(module.line_positions.size());
+	for(auto line : module.line_positions) put(line);
+	put(module.divisor_table.size());
+	for(auto &magic : module.divisor_table) {
+		put(magic.divisor);
+		put(magic.multiplier);
+		put(magic.shift);
+	}
+	put(module.object_templates.size());
+	for(auto &tpl : module.object_templates) {
+		put(tpl.names.size());
+		for(auto name : tpl.names) put(name);
+	}
+	put(module.frames.size());
+	for(auto &frame : module.frames) {
+		put(frame->up ? frame->up->frame_index + 1 : 0);
+		put(frame->max_stack);
+		for(auto decls : {&frame->closed_declarations, &frame->var_declarations, &frame->arg_declarations}) {
+			put(decls->size());
+			for(auto &decl : *decls) {
+				put(decl.name_index);
+				put((decl.is_closed ? uint64_t(DeclFlags::Closed) : 0)
+					| (decl.is_arg ? uint64_t(DeclFlags::Arg) : 0)
+					| (decl.is_mut ? uint64_t(DeclFlags::Mut) : 0));
+			}
+		}
+		// code words packed two to a word
+		put(frame->code.size());
+		for(size_t pos = 0; pos < frame->code.size(); pos += 2) {
+			uint64_t high = pos + 1 < frame->code.size() ? frame->code[pos + 1] : 0;
+			put(frame->code[pos] | (high << 32));
+		}
+	}
+	put(string_data.size());
+	auto body = reinterpret_cast<const char*>(words.data() + module_image_header_words);
+	words[module_image_header_words - 1] = fnv1a_hash(string_data.data(), string_data.size(),
+		fnv1a_hash(body, (words.size() - module_image_header_words) * sizeof(uint64_t)));
+	out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t));
+	out.write(string_data.data(), string_data.size());
+	return out.good();
+}
+bool write_module_image(std::ostream &dbg, const module_ptr &module, const string_view file_path) {
+	auto file = std::fstream(string(file_path), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	if(!file.is_open()) {
+		dbg << "could not open image for writing: " << file_path << '\n';
+		return false;
+	}
+	if(!write_module_image(file, *module)) {
+		dbg << "failed to write image: " << file_path << '\n';
+		return false;
+	}
+	return true;
+}
+
+struct MappedImage {
+	const char *data = nullptr;
+	size_t size = 0;
+#if defined(_WIN32)
+	std::string buffer;
+	bool map(const string_view file_path) {
+		if(!LoadFileV(file_path, buffer)) return false;
+		data = buffer.data();
+		size = buffer.size();
+		return true;
+	}
+#else
+	bool map(const string_view file_path) {
+		int fd = ::open(string(file_path).c_str(), O_RDONLY);
+		if(fd < 0) return false;
+		struct stat file_stat;
+		if(::fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void *mapping = ::mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(mapping == MAP_FAILED) return false;
+		data = static_cast<const char*>(mapping);
+		size = file_stat.st_size;
+		return true;
+	}
+	~MappedImage() {
+		if(data) ::munmap(const_cast<char*>(data), size);
+	}
+#endif
+};
+module_ptr load_module_image(std::ostream &dbg, const string_view file_path) {
+	auto image = std::make_shared<MappedImage>();
+	if(!image->map(file_path)) {
+		dbg << "could not map image: " << file_path << '\n';
+		return nullptr;
+	}
+	size_t word_count = image->size / sizeof(uint64_t);
+	size_t cursor = 0;
+	bool overrun = false;
+	auto get = [&]() -> uint64_t {
+		if(cursor >= word_count) {
+			overrun = true;
+			return 0;
+		}
+		uint64_t v;
+		std::copy_n(image->data + cursor * sizeof(uint64_t), sizeof(v), reinterpret_cast<char*>(&v));
+		cursor++;
+		return v;
+	};
+	// a count is valid when that many items of "width" words can still follow
+	auto get_count = [&](size_t width) -> uint64_t {
+		uint64_t count = get();
+		if(count > (word_count - cursor) / width) {
+			overrun = true;
+			return 0;
+		}
+		return count;
+	};
+	uint64_t magic_word = 0;
+	std::copy_n(module_image_magic, sizeof(magic_word), reinterpret_cast<char*>(&magic_word));
+	if(get() != magic_word) {
+		dbg << "not a bytecode image: " << file_path << '\n';
+		return nullptr;
+	}
+	if(get() != module_image_version || get() != opcode_set_signature()) {
+		dbg << "bytecode image version mismatch, recompile: " << file_path << '\n';
+		return nullptr;
+	}
+	uint64_t checksum = get();
+	if(overrun || checksum != fnv1a_hash(image->data + cursor * sizeof(uint64_t), image->size - cursor * sizeof(uint64_t))) {
+		dbg << "corrupt bytecode image, checksum mismatch: " << file_path << '\n';
+		return nullptr;
+	}
+	module_ptr module = std::make_shared<ModuleContext>(std::string{});
+	module->string_table.clear();
+	module->frames.clear();
+	std::vector<std::pair<uint64_t, uint64_t>> string_ranges(get_count(2));
+	for(auto &range : string_ranges) {
+		range.first = get();
+		range.second = get();
+	}
+	std::vector<std::pair<uint64_t, uint64_t>> import_entries(get_count(2));
+	for(auto &entry : import_entries) {
+		entry.first = get();
+		entry.second = get();
+	}
+	module->line_positions.resize(get_count(1));
+	for(auto &line : module->line_positions) line = get();
+	module->divisor_table.resize(get_count(3));
+	for(auto &magic : module->divisor_table) {
+		magic.divisor = get();
+		magic.multiplier = get();
+		magic.shift = static_cast<uint32_t>(get());
+	}
+	module->object_templates.resize(get_count(1));
+	for(auto &tpl : module->object_templates) {
+		tpl.names.resize(get_count(1));
+		for(auto &name : tpl.names) {
+			name = get();
+			if(name >= string_ranges.size()) overrun = true;
+		}
+	}
+	size_t frame_count = get_count(6);
+	for(size_t frame_index = 0; frame_index < frame_count && !overrun; frame_index++) {
+		uint64_t up_index = get();
+		if(up_index > frame_index) {
+			dbg << "bytecode image frame " << frame_index << " has an invalid parent\n";
+			return nullptr;
+		}
+		auto frame = up_index == 0
+			? std::make_shared<FrameContext>(frame_index)
+			: std::make_shared<FrameContext>(frame_index, module->frames[up_index - 1]);
+		frame->max_stack = get();
+		for(auto decls : {&frame->closed_declarations, &frame->var_declarations, &frame->arg_declarations}) {
+			size_t decl_count = get_count(2);
+			for(size_t decl_index = 0; decl_index < decl_count; decl_index++) {
+				uint64_t name_index = get();
+				uint64_t flags = get();
+				if(name_index >= string_ranges.size()) overrun = true;
+				auto &decl = decls->emplace_back(VariableDeclaration{name_index,
+					(flags & uint64_t(DeclFlags::Arg)) != 0, (flags & uint64_t(DeclFlags::Mut)) != 0});
+				decl.is_closed = (flags & uint64_t(DeclFlags::Closed)) != 0;
+			}
+		}
+		uint64_t code_size = get();
+		if(code_size > (word_count - cursor) * 2) {
+			overrun = true;
+			break;
+		}
+		frame->code.resize(code_size);
+		for(size_t pos = 0; pos < code_size; pos += 2) {
+			uint64_t packed = get();
+			frame->code[pos] = static_cast<uint32_t>(packed);
+			if(pos + 1 < code_size) frame->code[pos + 1] = static_cast<uint32_t>(packed >> 32);
+		}
+		std::vector<Instruction> decoded;
+		if(!decode_code(frame->code, decoded)) {
+			dbg << "bytecode image has invalid code in frame " << frame_index << '\n';
+			return nullptr;
+		}
+		module->frames.push_back(std::move(frame));
+	}
+	size_t string_bytes = get();
+	size_t string_start = cursor * sizeof(uint64_t);
+	if(overrun || module->frames.empty() || string_bytes > image->size - string_start) {
+		dbg << "truncated bytecode image: " << file_path << '\n';
+		return nullptr;
+	}
+	// strings stay in the mapping, no copies
+	for(auto &range : string_ranges) {
+		if(range.first > string_bytes || range.second > string_bytes - range.first) {
+			dbg << "bytecode image has an invalid string entry\n";
+			return nullptr;
+		}
+		module->string_table.emplace_back(image->data + string_start + range.first, range.second);
+	}
+	for(auto &entry : import_entries) {
+		if(entry.first >= module->string_table.size()) {
+			dbg << "bytecode image has an invalid import entry\n";
+			return nullptr;
+		}
+		module->imports.emplace_back(std::make_unique<VariableExtern>(
+			VariableExtern{string(module->string_table[entry.first]), static_cast<uint32_t>(entry.second)}));
+	}
+	module->root_context = module->frames.front();
+	module->image = std::move(image);
+	count_module_stats(*module);
+	return module;
+}
+
+static bool verify_frame(std::ostream &err, const ModuleContext &module, const FrameContext &frame, size_t string_count) {
+	std::vector<Instruction> list;
+	if(!decode_code(frame.code, list)) {
+		err << "verify: frame " << frame.frame_index << ": malformed code\n";
+		return false;
+	}
+	auto fail = [&](size_t index, const char *why) {
+		err << "verify: frame " << frame.frame_index << " [" << index << "] " << list[index] << ": " << why << '\n';
+		return false;
+	};
+	for(size_t index = 0; index < list.size(); index++) {
+		auto &ins = list[index];
+		switch(ins.opcode) {
+		case Opcode::LoadLocal:
+		case Opcode::StoreLocal:
+			if(ins.param_a != 0 || ins.param_b >= frame.var_declarations.size())
+				return fail(index, "local slot out of range");
+			break;
+		case Opcode::LoadArg:
+			if(ins.param_a != 0 || ins.param_b >= frame.arg_declarations.size())
+				return fail(index, "argument slot out of range");
+			break;
+		case Opcode::LoadVariable:
+		case Opcode::StoreVariable: {
+			auto scope = &frame;
+			for(uint32_t up = ins.param_a; up != 0 && scope; up--) scope = scope->up.get();
+			if(!scope) return fail(index, "up count leaves the scope chain");
+			if(ins.param_b >= scope->closed_declarations.size())
+				return fail(index, "closed slot out of range");
+			break;
+		}
+		case Opcode::LoadClosure:
+			if(ins.param >= module.frames.size() || module.frames[ins.param]->up.get() != &frame)
+				return fail(index, "closure of a frame that is not nested here");
+			break;
+		case Opcode::LoadString:
+		case Opcode::NamedLookup:
+		case Opcode::AssignNamed:
+			if(ins.param >= string_count) return fail(index, "string index out of range");
+			break;
+		case Opcode::LoadConstRef:
+			if(ins.param >= module.constants.size()) return fail(index, "constant index out of range");
+			break;
+		case Opcode::NamedLookupSite:
+		case Opcode::AssignNamedSite:
+			if(ins.param >= module.named_sites.size()) return fail(index, "named site out of range");
+			break;
+		case Opcode::DivMagicInteger:
+		case Opcode::ModMagicInteger:
+			if(ins.param >= module.divisor_table.size()) return fail(index, "divisor index out of range");
+			break;
+		case Opcode::NewObjectFromTemplate:
+			if(ins.param >= module.object_templates.size() || !module.object_templates[ins.param].shape)
+				return fail(index, "object template out of range");
+			break;
+		default: break;
+		}
+	}
+	auto stack = check_operand_stack(list, module.object_templates);
+	if(stack.bad_index != SIZE_MAX) return fail(stack.bad_index, stack.why);
+	if(stack.max_depth > frame.max_stack) {
+		err << "verify: frame " << frame.frame_index << ": operand stack deeper than max_stack\n";
+		return false;
+	}
+	return true;
+}
+static bool verify_module(std::ostream &err, const ModuleContext &module, size_t string_count) {
+	for(auto &frame : module.frames) {
+		if(!verify_frame(err, module, *frame, string_count)) return false;
+	}
+	for(auto &import_ptr : module.imports) {
+		if(import_ptr->pos >= module.root_context->closed_declarations.size()) {
+			err << "verify: import " << import_ptr->var_name << " has no slot\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+struct UpScope;
+struct ScopePool;
+// counted reference to a scope, not atomic, scopes never leave their VM
+class ScopeRef {
+	UpScope *scope = nullptr;
+public:
+	ScopeRef() = default;
+	// takes over a reference the caller already counted
+	explicit ScopeRef(UpScope *s) : scope{s} {}
+	ScopeRef(const ScopeRef &v);
+	ScopeRef(ScopeRef &&v) : scope{v.scope} { v.scope = nullptr; }
+	~ScopeRef() { reset(); }
+	ScopeRef &operator=(ScopeRef v) {
+		std::swap(scope, v.scope);
+		return *this;
+	}
+	void reset();
+	UpScope *get() const { return scope; }
+	UpScope *operator->() const { return scope; }
+	explicit operator bool() const { return scope != nullptr; }
+};
+struct UpScope {
+	ScopeRef up;
+	std::vector<HeapRegister> vars;
+	// display[n] is the scope n levels up, display[0] this one, so a variable
+	// of the nearest enclosing scopes is one index away. the window is fixed,
+	// taking a scope copies it and not the whole chain. up keeps them all alive
+	static constexpr uint32_t display_span = 8;
+	std::array<UpScope*, display_span> display{};
+	// number of scopes above this one
+	uint32_t depth = 0;
+	uint32_t mark = 0;
+	uint32_t refs = 0;
+	ScopePool *pool = nullptr;
+	// scopes further up than the window hop through the last entry
+	UpScope *scope_up(uint32_t levels) {
+		UpScope *scope = this;
+		for(; levels >= display_span; levels -= display_span - 1)
+			scope = scope->display[display_span - 1];
+		return scope->display[levels];
+	}
+};
+// frames take their scope from here and give it back on return. a scope
+// only outlives its frame when a closure captured it, and is given back
+// when the last closure lets go. reused scopes keep their vars storage
+struct ScopePool {
+	std::vector<UpScope*> free;
+	ScopePool() = default;
+	ScopePool(const ScopePool &) = delete;
+	~ScopePool() {
+		for(auto scope : free) delete scope;
+	}
+	ScopeRef take(const ScopeRef &up, size_t var_count) {
+		UpScope *scope;
+		if(free.empty()) {
+			scope = new UpScope{};
+			scope->pool = this;
+		} else {
+			scope = free.back();
+			free.pop_back();
+		}
+		scope->up = up;
+		scope->vars.resize(var_count);
+		scope->display[0] = scope;
+		if(up) {
+			std::copy(up->display.begin(), up->display.end() - 1, scope->display.begin() + 1);
+			scope->depth = up->depth + 1;
+		} else {
+			std::fill(scope->display.begin() + 1, scope->display.end(), nullptr);
+			scope->depth = 0;
+		}
+		scope->refs = 1;
+		return ScopeRef{scope};
+	}
+	void give_back(UpScope *scope) {
+		scope->up.reset();
+		scope->vars.clear();
+		// a reused scope is new to a running collection
+		scope->mark = 0;
+		free.push_back(scope);
+	}
+};
+inline ScopeRef::ScopeRef(const ScopeRef &v) : scope{v.scope} {
+	if(scope) scope->refs++;
+}
+inline void ScopeRef::reset() {
+	auto released = scope;
+	scope = nullptr;
+	if(released && --released->refs == 0) released->pool->give_back(released);
+}
+// marks what is reachable from the roots. objects wait on the gray list
+// until their references are traced, so deep structures don't recurse.
+// the list holds a reference, marking may be spread over many steps
+// and the program can drop an object while it waits
+struct HeapCollector {
+	uint32_t epoch = 0;
+	std::vector<VMVar*> gray;
+	void shade(VMVar *v) {
+		v->mark = epoch;
+		v->add_ref();
+		gray.push_back(v);
+	}
+	void visit(VMVar *v) {
+		if(v->mark != epoch) shade(v);
+	}
+	void visit(const Register &r) {
+		if(is_vtype_pointer(r.vtype)) visit(r.ptr());
+	}
+	void visit(UpScope *scope) {
+		for(; scope && scope->mark != epoch; scope = scope->up.get()) {
+			scope->mark = epoch;
+			for(auto &r : scope->vars) visit(r);
+		}
+	}
+	void trace_one() {
+		auto v = gray.back();
+		gray.pop_back();
+		v->trace(*this);
+		v->del_ref();
+	}
+	void drain() {
+		while(!gray.empty()) trace_one();
+	}
+};
+struct VMFunction : VMVar {
+	ScopeRef up;
+	size_t scope_id;
+	VMFunction(ScopeRef _up, size_t _id)
+		: up{_up}, scope_id{_id} {}
+	VarType get_type() const { return VarType::Function; }
+	void trace(HeapCollector &gc) { gc.visit(up.get()); }
+	void clear_refs() { up.reset(); }
+	size_t heap_size() const { return sizeof(VMFunction); }
+};
+struct VMArray : VMVar {
+	std::vector<HeapRegister> values;
+	VMArray() {}
+	VarType get_type() const { return VarType::Array; }
+	void trace(HeapCollector &gc) {
+		for(auto &r : values) gc.visit(r);
+	}
+	void clear_refs() { values.clear(); }
+	size_t heap_size() const {
+		return sizeof(VMArray) + values.capacity() * sizeof(HeapRegister);
+	}
+};
+// member names of a line of shapes, a shape sees the first slot_count.
+// a transition that appends to the end of the list shares it
+struct ShapeNames {
+	// up to this many names are scanned, longer lists keep an index
+	static constexpr size_t scan_limit = 8;
+	std::vector<size_t> names;
+	std::unordered_map<size_t, uint32_t> index;
+	void push(size_t name) {
+		names.push_back(name);
+		if(names.size() <= scan_limit) return;
+		if(index.empty()) {
+			for(uint32_t slot = 0; slot < names.size(); slot++) index.emplace(names[slot], slot);
+		} else {
+			index.emplace(name, static_cast<uint32_t>(names.size() - 1));
+		}
+	}
+};
+// hidden class of an object: which member is in which slot. objects that
+// get the same members in the same order share a shape. shapes are made
+// on first use and live as long as the VM
+struct Shape {
+	static constexpr uint32_t no_slot = ~uint32_t{0};
+	std::shared_ptr<ShapeNames> names;
+	uint32_t slot_count;
+	// the shape after adding a member, by string index
+	std::unordered_map<size_t, std::unique_ptr<Shape>> transitions;
+	Shape(std::shared_ptr<ShapeNames> n, uint32_t count)
+		: names{std::move(n)}, slot_count{count} {}
+	uint32_t find(size_t name) const {
+		if(slot_count <= ShapeNames::scan_limit) {
+			for(uint32_t slot = 0; slot < slot_count; slot++) {
+				if(names->names[slot] == name) return slot;
+			}
+			return no_slot;
+		}
+		auto found = names->index.find(name);
+		if(found == names->index.end() || found->second >= slot_count) return no_slot;
+		return found->second;
+	}
+	// name must not be in this shape yet
+	Shape *add(size_t name) {
+		auto &next = transitions[name];
+		if(!next) {
+			auto next_names = names;
+			if(next_names->names.size() != slot_count) {
+				// another transition took the end of the list, copy our part
+				next_names = std::make_shared<ShapeNames>();
+				for(uint32_t slot = 0; slot < slot_count; slot++) next_names->push(names->names[slot]);
+			}
+			next_names->push(name);
+			next = std::make_unique<Shape>(std::move(next_names), slot_count + 1);
+		}
+		return next.get();
+	}
+	size_t name_of(uint32_t slot) const { return names->names[slot]; }
+};
+// members are kept in slot order, the shape names them
+struct VMObject : VMVar {
+	Shape *shape;
+	std::vector<HeapRegister> slots;
+	VMObject(Shape *empty_shape) : shape{empty_shape} {}
+	VarType get_type() const { return VarType::Object; }
+	void trace(HeapCollector &gc) {
+		for(auto &r : slots) gc.visit(r);
+	}
+	void clear_refs() { slots.clear(); }
+	size_t heap_size() const {
+		return sizeof(VMObject) + slots.capacity() * sizeof(HeapRegister);
+	}
+	HeapRegister *find(size_t name) {
+		uint32_t slot = shape->find(name);
+		return slot == Shape::no_slot ? nullptr : &slots[slot];
+	}
+	void add(size_t name, const Register &value) {
+		shape = shape->add(name);
+		slots.emplace_back(value);
+	}
+};
+// frame records live in the task's frames vector, the module owns the context
+struct StackFrame {
+	FrameContext *context;
+	ScopeRef scope;
+	// where execution continues when returning to this frame
+	const uint32_t *current_instruction = nullptr;
+	size_t first_arg_pos = 0;
+	// end of the arguments the caller pushed, the stack is cut back to here on return
+	size_t end_arg_pos = 0;
+	size_t first_var_pos = 0;
+	StackFrame(FrameContext *ctx, ScopeRef scope_ref)
+		: context{ctx}, scope{std::move(scope_ref)} { }
+};
+
+
+// operand and local storage of a task. storage only grows in reserve(), which
+// runs at frame entry with the frame's whole footprint, pushes are pointer bumps
+class ValueStack {
+	Register *base = nullptr;
+	Register *top = nullptr;
+	Register *limit = nullptr;
+	void grow(size_t wanted) {
+		size_t capacity = std::max(wanted, 2 * static_cast<size_t>(limit - base));
+		auto storage = std::allocator<Register>{}.allocate(capacity);
+		auto moved = storage;
+		for(auto item = base; item != top; item++, moved++) {
+			std::construct_at(moved, std::move(*item));
+			std::destroy_at(item);
+		}
+		if(base) std::allocator<Register>{}.deallocate(base, limit - base);
+		base = storage;
+		top = moved;
+		limit = storage + capacity;
+	}
+public:
+	ValueStack() = default;
+	ValueStack(const ValueStack &) = delete;
+	~ValueStack() {
+		truncate(0);
+		if(base) std::allocator<Register>{}.deallocate(base, limit - base);
+	}
+	void reserve(size_t wanted) {
+		if(wanted > static_cast<size_t>(limit - base)) grow(wanted);
+	}
+	size_t size() const { return top - base; }
+	size_t capacity() const { return limit - base; }
+	bool empty() const { return top == base; }
+	bool full() const { return top == limit; }
+	Register &operator[](size_t index) { return base[index]; }
+	const Register &operator[](size_t index) const { return base[index]; }
+	Register &back() { return top[-1]; }
+	// the value "depth" entries below the top
+	Register &from_top(size_t depth) { return top[-1 - static_cast<ptrdiff_t>(depth)]; }
+	Register *begin() { return base; }
+	Register *end() { return top; }
+	const Register *cbegin() const { return base; }
+	const Register *cend() const { return top; }
+	void push_back(const Register &value) {
+		assert(top != limit);
+		std::construct_at(top++, value);
+	}
+	void pop_back() {
+		std::destroy_at(--top);
+	}
+	void truncate(size_t new_size) {
+		auto new_top = base + new_size;
+		while(top > new_top) std::destroy_at(--top);
+	}
+	void resize(size_t new_size, const Register &fill) {
+		reserve(new_size);
+		truncate(new_size);
+		while(size() < new_size) std::construct_at(top++, fill);
+	}
+};
 
-std::ostream &operator<<(std::ostream &os, const Register &v);
+// highest trace level compiled in, lower it to remove the trace code entirely
+#if !defined(FAE_TRACE_MAX)
+#define FAE_TRACE_MAX 5
+#endif
+// compared through an int constant, a bare 0 against the enum warns with -Wtype-limits
+constexpr int trace_max_level = FAE_TRACE_MAX;
+static_assert(trace_max_level <= static_cast<int>(TraceLevel::Values), "FAE_TRACE_MAX is above the highest trace level");
+constexpr bool trace_compiled(TraceLevel level) {
+	return static_cast<int>(level) <= trace_max_level;
+}
+// writes only when a sink is set, otherwise nothing is formatted
+struct TraceStream {
+	std::ostream *out = nullptr;
+	explicit operator bool() const { return out != nullptr; }
+	template<class T>
+	TraceStream &operator<<(const T &v) {
+		if(out) *out << v;
+		return *this;
+	}
+};
+
+// runtime errors always reach stderr, and the trace as well when it shows errors
+struct ErrorStream {
+	std::ostream *trace = nullptr;
+	template<class T>
+	ErrorStream &operator<<(const T &v) {
+		std::cerr << v;
+		if(trace) *trace << v;
+		return *this;
+	}
+};
 
 struct FaeVM;
+// registers don't know their VM, printing one needs it for strings and names
+struct ShowRegister {
+	const FaeVM &vm;
+	const Register &reg;
+};
+std::ostream &operator<<(std::ostream &os, const ShowRegister &show);
 struct FaeTask {
-	std::vector<std::shared_ptr<StackFrame>> scope_stack;
-	std::vector<Register> value_stack;
+	// one record per active call, the last one is current_frame
+	std::vector<StackFrame> frames;
+	ValueStack value_stack;
 	Register accumulator;
-	std::shared_ptr<StackFrame> current_frame;
+	StackFrame *current_frame = nullptr;
 	FaeVM &vm;
+	// the module being run, kept so an out of fuel task can resume
+	module_ptr module;
+	uint64_t fuel = unlimited_fuel;
+	RunStatus status = RunStatus::Finished;
 	FaeTask(FaeVM &vm);
-	void enter_frame(std::shared_ptr<FrameContext> context, std::shared_ptr<UpScope> up);
+	void push_frame(FrameContext *context, const ScopeRef &up);
+	void pop_frame() {
+		frames.pop_back();
+		current_frame = frames.empty() ? nullptr : &frames.back();
+	}
+	void enter_frame(FrameContext *context);
 	size_t var_stack_size() const {
 		size_t var_end = current_frame->first_var_pos + current_frame->context->var_declarations.size();
 		return value_stack.size() - var_end;
 	}
-	void show_accum(std::ostream &out) const {
-		out << "A: " << accumulator << '\n';
+	void show_accum(TraceStream out) const {
+		if(!out) return;
+		out << "A: " << ShowRegister{vm, accumulator} << '\n';
 	}
-	void show_args(std::ostream &out) const {
+	void show_args(TraceStream out) const {
+		if(!out) return;
 		out << "Args:";
 		if(value_stack.empty() || current_frame->first_var_pos == current_frame->first_arg_pos) {
 			out << "<E!>";
@@ -3362,13 +4966,14 @@ struct FaeTask {
 			auto begin = value_stack.cbegin();
 			auto end = begin + current_frame->first_var_pos;
 			for(auto v = begin + current_frame->first_arg_pos; v != end; v++) {
-				out << " " << *v;
+				out << " " << ShowRegister{vm, *v};
 			}
 		}
 		out << '\n';
 	};
-	void show_vars(std::ostream &out) const {
-		out << " A: " << accumulator;
+	void show_vars(TraceStream out) const {
+		if(!out) return;
+		out << " A: " << ShowRegister{vm, accumulator};
 		auto local_size = current_frame->context->var_declarations.size();
 		auto close_size = current_frame->context->closed_declarations.size();
 		out << "\n Vars:";
@@ -3376,7 +4981,7 @@ struct FaeTask {
 			out << "<E!>";
 		} else {
 			for(auto &v : current_frame->scope->vars) {
-				out << " " << v;
+				out << " " << ShowRegister{vm, v};
 			}
 		}
 		out << "\n Locals:";
@@ -3390,12 +4995,12 @@ struct FaeTask {
 			auto locals_end = current_frame->first_var_pos + local_size >= value_stack.size() ?
 				value_stack.cend() : stack_itr + local_size;
 			for(; stack_itr != locals_end; stack_itr++) {
-				out << " " << *stack_itr;
+				out << " " << ShowRegister{vm, *stack_itr};
 			}
 		}
 		out << "\n Stack:";
 		if(stack_itr == value_stack.cend()) out << "<E!>";
-		else for(;stack_itr != value_stack.cend(); stack_itr++) { out << " " << *stack_itr; }
+		else for(;stack_itr != value_stack.cend(); stack_itr++) { out << " " << ShowRegister{vm, *stack_itr}; }
 		out << '\n';
 	};
 	Register pop_value() {
@@ -3405,39 +5010,187 @@ struct FaeTask {
 	};
 };
 
+// string values are immutable. literals view their interned text, strings
+// made at run time own theirs and are never interned
+struct VMString : VMVar {
+	size_t length = 0;
+	VarType get_type() const { return VarType::String; }
+	// valid while the string lives
+	virtual string_view text() = 0;
+};
+// a literal, the text is the interned copy in FaeVM::str_table
+struct VMInternedString : VMString {
+	size_t string_index;
+	string_view interned;
+	VMInternedString(size_t index, string_view sv) : string_index{index}, interned{sv} {
+		length = sv.size();
+	}
+	string_view text() { return interned; }
+	size_t heap_size() const { return sizeof(VMInternedString); }
+};
+// a short string made at run time, the text is stored in the object
+struct VMSmallString : VMString {
+	static constexpr size_t capacity = 24;
+	char chars[capacity];
+	VMSmallString(string_view head, string_view tail) {
+		length = head.size() + tail.size();
+		assert(length <= capacity);
+		std::ranges::copy(tail, std::ranges::copy(head, chars).out);
+	}
+	string_view text() { return string_view{chars, length}; }
+	size_t heap_size() const { return sizeof(VMSmallString); }
+};
+// a concatenation, made without copying either half. the halves are
+// joined the first time the text is read, then let go
+struct VMRopeString : VMString {
+	HeapRegister head;
+	HeapRegister tail;
+	std::string flat;
+	VMRopeString(const Register &h, const Register &t) : head{h}, tail{t} {
+		length = static_cast<VMString*>(h.ptr())->length + static_cast<VMString*>(t.ptr())->length;
+	}
+	bool joined() const { return !is_vtype_pointer(head.vtype); }
+	string_view text();
+	void trace(HeapCollector &gc) {
+		gc.visit(head);
+		gc.visit(tail);
+	}
+	void clear_refs() {
+		head = Register();
+		tail = Register();
+	}
+	size_t heap_size() const { return sizeof(VMRopeString) + flat.capacity(); }
+};
+string_view VMRopeString::text() {
+	if(joined()) return flat;
+	flat.reserve(length);
+	// ropes built by appending in a loop are as deep as they are long,
+	// so the parts are walked with a list instead of recursion
+	std::vector<VMString*> pending{
+		static_cast<VMString*>(tail.ptr()), static_cast<VMString*>(head.ptr())};
+	while(!pending.empty()) {
+		auto part = pending.back();
+		pending.pop_back();
+		auto rope = dynamic_cast<VMRopeString*>(part);
+		if(rope && !rope->joined()) {
+			pending.push_back(static_cast<VMString*>(rope->tail.ptr()));
+			pending.push_back(static_cast<VMString*>(rope->head.ptr()));
+		} else {
+			flat.append(part->text());
+		}
+	}
+	clear_refs();
+	return flat;
+}
+// same type and value, strings compare by their text
+static bool same_value(const Register &lh, const Register &rh) {
+	if(lh.vtype != rh.vtype) return false;
+	if(lh.value == rh.value) return true;
+	if(lh.vtype != VarType::String) return false;
+	return static_cast<VMString*>(lh.ptr())->text() == static_cast<VMString*>(rh.ptr())->text();
+}
+
+enum class GcPhase : uint8_t { Idle, Marking, Sweeping };
 struct FaeVM {
-	std::vector<string> str_table;
-	std::vector<VarRef> var_table;
+	// first members, so they outlive every register the other members hold
+	HeapLinks heap_list;
+	// placeholder in heap_list that an incremental sweep advances
+	HeapLinks gc_sweep_cursor;
+	ZeroCountTable zct;
+	ScopePool scope_pool;
+	// every object starts out with this shape
+	Shape empty_shape{std::make_shared<ShapeNames>(), 0};
+	// interned strings, a deque so str_index can keep views of them.
+	// indexes never change once given out
+	std::deque<string> str_table;
+	// first index of each string
+	std::unordered_map<string_view, size_t> str_index;
+#if FAE_HEAP_REGISTRY
+	HeapRegistry var_table;
+#endif
 	std::unordered_map<size_t, module_ptr> script_map;
 	std::vector<std::shared_ptr<FaeTask>> tasks;
 	std::shared_ptr<FaeTask> current_task;
-	std::unordered_map<size_t, Register> imports_table;
+	std::unordered_map<size_t, HeapRegister> imports_table;
+	ExecutionMode execution_mode = ExecutionMode::Fast;
+	// a collection is due once this many bytes were allocated since the last one,
+	// the larger of gc_min_bytes and gc_growth_percent of the heap that survived
+	uint64_t gc_min_bytes = 1 << 20;
+	uint32_t gc_growth_percent = 100;
+	uint64_t gc_allocated = 0;
+	uint64_t gc_threshold = 1 << 20;
+	uint32_t gc_epoch = 0;
+	// set by put_variable, the interpreter collects at its next safepoint
+	bool gc_pending = false;
+	// 0 collects in one pause, otherwise each safepoint does at most this much
+	uint64_t gc_pause_budget_ns = 0;
+	GcPhase gc_phase = GcPhase::Idle;
+	HeapCollector gc_marker;
+	uint64_t gc_cycle_freed = 0;
+	GcStats gc_stats;
+	// zero count objects are checked against the stacks once this many queue up
+	size_t zct_limit = 1024;
+	uint32_t zct_epoch = 0;
+	TraceLevel trace_level = TraceLevel::Off;
+	std::ostream *trace_sink = nullptr;
 	FaeVM();
+	~FaeVM();
+	bool tracing(TraceLevel level) const {
+		return trace_compiled(level) && level != TraceLevel::Off
+			&& level <= trace_level && trace_sink != nullptr;
+	}
+	TraceStream trace(TraceLevel level) const {
+		return TraceStream{tracing(level) ? trace_sink : nullptr};
+	}
+	ErrorStream errors() const {
+		return ErrorStream{tracing(TraceLevel::Errors) ? trace_sink : nullptr};
+	}
 	Register put_variable(VMVar *v) {
-		var_table.emplace_back(VarRef{v});
-		return Register{*this, var_table.size() - 1, v->get_type()};
+		v->heap_prev = &heap_list;
+		v->heap_next = heap_list.heap_next;
+		heap_list.heap_next->heap_prev = v;
+		heap_list.heap_next = v;
+		gc_allocated += v->heap_size();
+		if(gc_allocated >= gc_threshold) gc_pending = true;
+		// new objects survive the running collection, their contents are traced
+		if(gc_phase == GcPhase::Marking) gc_marker.shade(v);
+		else if(gc_phase == GcPhase::Sweeping) v->mark = gc_epoch;
+#if FAE_HEAP_REGISTRY
+		v->registry = &var_table;
+		v->heap_id = var_table.add(v);
+#endif
+		// nothing counts it until it is stored somewhere
+		v->zct = &zct;
+		v->in_zct = true;
+		zct.entries.push_back(v);
+		return Register{*v, v->get_type()};
+	}
+	size_t add_string(string_view sv) {
+		size_t index = str_table.size();
+		str_index.try_emplace(str_table.emplace_back(sv), index);
+		return index;
+	}
+	// text of an interned string, the two reserved entries stand for ""
+	string_view string_text(size_t index) const {
+		return index <= 1 ? string_view{} : string_view{str_table[index]};
 	}
 	size_t find_string(string_view sv) const {
-		auto func_str_itr = std::ranges::find_if(
-			str_table, [&](auto &v) { return sv == v; } );
-		if(func_str_itr == str_table.cend()) {
+		auto found = str_index.find(sv);
+		if(found == str_index.cend()) {
 			std::cerr << "string not found: \"" << sv << '\n';
 			return 0;
 		}
-		if(func_str_itr == str_table.cbegin()) return 1; // special case the "empty" string.
-		return func_str_itr - str_table.cbegin();
+		if(found->second == 0) return 1; // special case the "empty" string.
+		return found->second;
 	}
 	size_t find_or_add_string(string_view sv) {
-		auto func_str_itr = std::ranges::find_if(
-			str_table, [&](auto &v) { return sv == v; } );
-		if(func_str_itr == str_table.cbegin()) return 1; // special case the "empty" string.
-		if(func_str_itr == str_table.cend()) {
-			str_table.push_back(string(sv));
-			return str_table.size() - 1;
-		}
-		return func_str_itr - str_table.cbegin();
+		auto found = str_index.find(sv);
+		if(found == str_index.cend()) return add_string(sv);
+		if(found->second == 0) return 1; // special case the "empty" string.
+		return found->second;
 	}
 	void load_module(string_view module_name, module_ptr module) {
+		PhaseTimer timer{module->stats.load_ns};
 		size_t index = find_or_add_string(module_name);
 		std::vector<size_t> str_conversions;
 		str_conversions.reserve(module->string_table.size());
@@ -3445,27 +5198,93 @@ struct FaeVM {
 		for(auto &str : std::span(module->string_table.cbegin() + 1, module->string_table.cend())) {
 			str_conversions.push_back(find_or_add_string(str));
 		}
+		// templates get the shape their objects will have
+		for(auto &tpl : module->object_templates) {
+			Shape *shape = &empty_shape;
+			for(auto name : tpl.names) {
+				size_t str_index = str_conversions.at(name);
+				if(shape->find(str_index) != Shape::no_slot) {
+					std::cerr << "object template repeats a member: " << str_table[str_index] << '\n';
+					return;
+				}
+				shape = shape->add(str_index);
+			}
+			tpl.shape = shape;
+		}
+		// string literals become shared constants, one per distinct string
+		std::unordered_map<size_t, size_t> string_constants;
+		std::vector<Instruction> decoded;
 		for(auto &frame : module->frames) {
-			for(auto &ins : frame->instructions) {
+			// string indexes can change width, so the code is rebuilt
+			if(!decode_code(frame->code, decoded)) {
+				std::cerr << "invalid code in frame " << frame->frame_index << '\n';
+				return;
+			}
+			for(auto &ins : decoded) {
 				switch(ins.opcode) {
-					case Opcode::NamedLookup:
-					case Opcode::AssignNamed:
-					case Opcode::LoadString:
-					ins.param = str_conversions.at(ins.param);
+				// every member access gets its own inline cache
+				case Opcode::NamedLookup:
+				case Opcode::AssignNamed:
+					module->named_sites.push_back(NamedSite{str_conversions.at(ins.param), {}});
+					ins.opcode = ins.opcode == Opcode::NamedLookup
+						? Opcode::NamedLookupSite : Opcode::AssignNamedSite;
+					ins.param = module->named_sites.size() - 1;
+					break;
+				case Opcode::LoadString: {
+					size_t str_index = str_conversions.at(ins.param);
+					auto [found, added] = string_constants.try_emplace(str_index, module->constants.size());
+					if(added) module->constants.push_back(
+						put_variable(new VMInternedString(str_index, string_text(str_index))));
+					ins.opcode = Opcode::LoadConstRef;
+					ins.param = found->second;
 					break;
+				}
+				case Opcode::LoadConstRef:
+				case Opcode::NamedLookupSite:
+				case Opcode::AssignNamedSite:
+					// constant and site indexes only exist after linking
+					std::cerr << "linked instruction in unlinked code, frame " << frame->frame_index << '\n';
+					return;
 				default: break;
 				}
 			}
+			frame->code = encode_code(decoded);
+		}
+		module->verified = verify_module(std::cerr, *module, str_table.size());
+		if(!module->verified) {
+			std::cerr << "module failed verification: " << module_name << '\n';
+			return;
 		}
 		script_map[index] = module;
 	}
 	size_t stack_size() const { return current_task->value_stack.size(); }
-};
-
-struct VMString : VMVar {
-	size_t string_index = 0;
-	VMString(size_t index) : string_index{index} {}
-	VarType get_type() const { return VarType::String; }
+	// stores of a register into a heap object or scope, keeps the marking
+	// invariant: nothing already traced points at an unmarked object
+	void write_barrier(const Register &r) {
+		if(gc_phase == GcPhase::Marking) gc_marker.visit(r);
+	}
+	// a short result is copied into a new small string, a long one is a rope
+	Register concat_strings(const Register &head, const Register &tail) {
+		auto head_str = static_cast<VMString*>(head.ptr());
+		auto tail_str = static_cast<VMString*>(tail.ptr());
+		if(tail_str->length == 0) return head;
+		if(head_str->length == 0) return tail;
+		if(head_str->length + tail_str->length <= VMSmallString::capacity)
+			return put_variable(new VMSmallString(head_str->text(), tail_str->text()));
+		return put_variable(new VMRopeString(head, tail));
+	}
+	void reconcile_counts();
+	void gc_mark_roots();
+	void gc_begin();
+	bool gc_work(std::chrono::steady_clock::time_point deadline);
+	void gc_record_pause(std::chrono::steady_clock::time_point start);
+	void gc_step();
+	uint64_t collect_garbage();
+	void set_collector_trigger(uint64_t min_bytes, uint32_t growth_percent) {
+		gc_min_bytes = min_bytes;
+		gc_growth_percent = growth_percent;
+		gc_threshold = std::max(gc_min_bytes, gc_stats.live_bytes * gc_growth_percent / 100);
+	}
 };
 
 struct VMNativeFunction : VMVar {
@@ -3476,72 +5295,194 @@ struct VMNativeFunction : VMVar {
 };
 
 FaeVM::FaeVM() {
+	heap_list.heap_prev = heap_list.heap_next = &heap_list;
 	current_task = std::make_shared<FaeTask>(*this);
-	str_table.push_back(string{0, '\0'});
-	str_table.push_back(string{0, '\0'});
+	add_string(string{0, '\0'});
+	add_string(string{0, '\0'});
 	{
 		size_t sys_index = find_or_add_string("sys"sv);
 		VMObject *sys_obj;
-		imports_table.emplace(sys_index, put_variable(sys_obj = new VMObject{}));
-		sys_obj->values.emplace(
+		imports_table.emplace(sys_index, put_variable(sys_obj = new VMObject{&empty_shape}));
+		sys_obj->add(
 			find_or_add_string("randomInt"sv),
 			put_variable(new VMNativeFunction([](FaeTask &task) {
-				task.accumulator = Register{task.vm, uint64_t{4ull}};
+				task.accumulator = Register{uint64_t{4ull}};
 			})));
 	}
 	{
 		size_t io_index = find_or_add_string("io"sv);
 		VMObject *io_obj;
-		imports_table.emplace(io_index, put_variable(io_obj = new VMObject{}));
-		io_obj->values.emplace(
+		imports_table.emplace(io_index, put_variable(io_obj = new VMObject{&empty_shape}));
+		io_obj->add(
 			find_or_add_string("input"sv),
 			put_variable(new VMNativeFunction([](FaeTask &task) {
-				task.accumulator = Register{task.vm, uint64_t{4ull}};
+				task.accumulator = Register{uint64_t{4ull}};
 			})));
-		io_obj->values.emplace(
+		io_obj->add(
 			find_or_add_string("print"sv),
 			put_variable(new VMNativeFunction([](FaeTask &task) {
-				std::cout << "print:" << task.value_stack.back() << '\n';
+				std::cout << "print:" << ShowRegister{task.vm, task.value_stack.back()} << '\n';
 			})));
 	}
 }
 
-Register::~Register() {
-	if(is_vtype_pointer(vtype)) {
-		vm.var_table[value].del_ref();
+// drops every root, the last collection takes the cycles apart
+// and frees what is left on the zero count table
+FaeVM::~FaeVM() {
+	tasks.clear();
+	current_task.reset();
+	imports_table.clear();
+	// a module can outlive the VM, it must not keep counts on freed objects
+	for(auto &[name, module] : script_map) module->constants.clear();
+	script_map.clear();
+	collect_garbage();
+#if FAE_HEAP_REGISTRY
+	if(var_table.live != 0) std::cerr << "heap registry: " << var_table.live << " objects leaked\n";
+	assert(var_table.live == 0);
+#endif
+}
+
+// frees the zero count objects that no stack or accumulator points at.
+// only called where the stacks hold every uncounted reference:
+// at safepoints, and outside of run_module
+void FaeVM::reconcile_counts() {
+	uint32_t epoch = ++zct_epoch;
+	auto mark_task = [&](FaeTask &task) {
+		if(is_vtype_pointer(task.accumulator.vtype)) task.accumulator.ptr()->stack_mark = epoch;
+		for(auto &r : task.value_stack) {
+			if(is_vtype_pointer(r.vtype)) r.ptr()->stack_mark = epoch;
+		}
+	};
+	if(current_task) mark_task(*current_task);
+	for(auto &task : tasks) mark_task(*task);
+	std::vector<VMVar*> kept;
+	// freeing an object releases what it holds, which can queue more entries
+	for(size_t i = 0; i < zct.entries.size(); i++) {
+		auto v = zct.entries[i];
+		if(v->ref_count > 0) {
+			v->in_zct = false;
+		} else if(v->stack_mark == epoch) {
+			kept.push_back(v);
+		} else {
+			delete v;
+		}
 	}
-	vtype = VarType::Unset;
+	zct.entries.swap(kept);
 }
-Register::Register(FaeVM &_vm) : vm{_vm}, value{0}, vtype{VarType::Unset} {}
-Register::Register(const Register &v) : vm{v.vm}, value{v.value}, vtype{v.vtype} {
-	if(is_vtype_pointer(vtype)) {
-		vm.var_table[value].add_ref();
+
+// roots are the task stacks and their scope chains, imports and module
+// constants. stacks change without a write barrier, so they are scanned
+// again when marking runs out of work
+void FaeVM::gc_mark_roots() {
+	auto mark_task = [&](FaeTask &task) {
+		gc_marker.visit(task.accumulator);
+		for(auto &r : task.value_stack) gc_marker.visit(r);
+		for(auto &frame : task.frames) gc_marker.visit(frame.scope.get());
+	};
+	if(current_task) mark_task(*current_task);
+	for(auto &task : tasks) mark_task(*task);
+	for(auto &[name, r] : imports_table) gc_marker.visit(r);
+	for(auto &[name, module] : script_map) {
+		for(auto &r : module->constants) gc_marker.visit(r);
 	}
 }
-Register::Register(Register &&v) : vm{v.vm}, value{v.value}, vtype{v.vtype} {
-	v.vtype = VarType::Unset;
+void FaeVM::gc_begin() {
+	gc_marker.epoch = ++gc_epoch;
+	gc_cycle_freed = 0;
+	gc_stats.live_objects = 0;
+	gc_stats.live_bytes = 0;
+	gc_phase = GcPhase::Marking;
+	gc_mark_roots();
 }
-Register& Register::operator=(const Register &v) {
-	if(is_vtype_pointer(vtype)) {
-		vm.var_table[value].del_ref();
+// runs the current collection until the deadline, true once it is complete.
+// unmarked objects are only held by each other, so releasing what they
+// hold brings their counts down to the sweep's own reference
+bool FaeVM::gc_work(std::chrono::steady_clock::time_point deadline) {
+	// the clock is read once per batch of objects
+	constexpr size_t batch = 32;
+	auto out_of_time = [&]() { return std::chrono::steady_clock::now() >= deadline; };
+	while(gc_phase == GcPhase::Marking) {
+		for(size_t n = 0; n < batch && !gc_marker.gray.empty(); n++) gc_marker.trace_one();
+		if(gc_marker.gray.empty()) {
+			gc_mark_roots();
+			gc_marker.drain();
+			gc_phase = GcPhase::Sweeping;
+			gc_sweep_cursor.heap_prev = &heap_list;
+			gc_sweep_cursor.heap_next = heap_list.heap_next;
+			heap_list.heap_next->heap_prev = &gc_sweep_cursor;
+			heap_list.heap_next = &gc_sweep_cursor;
+		} else if(out_of_time()) {
+			return false;
+		}
 	}
-	if(is_vtype_pointer(v.vtype)) {
-		v.vm.var_table[v.value].add_ref();
+	while(gc_phase == GcPhase::Sweeping) {
+		for(size_t n = 0; n < batch; n++) {
+			auto link = gc_sweep_cursor.heap_next;
+			if(link == &heap_list) {
+				gc_sweep_cursor.unlink();
+				gc_phase = GcPhase::Idle;
+				break;
+			}
+			// step the cursor over the object first, freeing it unlinks it
+			gc_sweep_cursor.unlink();
+			gc_sweep_cursor.heap_prev = link;
+			gc_sweep_cursor.heap_next = link->heap_next;
+			link->heap_next->heap_prev = &gc_sweep_cursor;
+			link->heap_next = &gc_sweep_cursor;
+			auto v = static_cast<VMVar*>(link);
+			size_t size = v->heap_size();
+			if(v->mark == gc_epoch) {
+				gc_stats.live_objects++;
+				gc_stats.live_bytes += size;
+			} else {
+				gc_cycle_freed += size;
+				gc_stats.objects_freed++;
+				v->add_ref();
+				v->clear_refs();
+				v->del_ref();
+			}
+		}
+		if(gc_phase == GcPhase::Sweeping && out_of_time()) return false;
 	}
-	value = v.value;
-	vtype = v.vtype;
-	return *this;
+	gc_stats.collections++;
+	gc_stats.bytes_freed += gc_cycle_freed;
+	gc_allocated = 0;
+	gc_pending = false;
+	gc_threshold = std::max(gc_min_bytes, gc_stats.live_bytes * gc_growth_percent / 100);
+	// the garbage is on the zero count table now
+	reconcile_counts();
+	return true;
 }
-Register& Register::operator=(Register &&v) {
-	if(is_vtype_pointer(vtype)) {
-		vm.var_table[value].del_ref();
-	}
-	value = v.value;
-	vtype = v.vtype;
-	v.vtype = VarType::Unset;
-	return *this;
+void FaeVM::gc_record_pause(std::chrono::steady_clock::time_point start) {
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	gc_stats.total_ns += ns;
+	gc_stats.max_pause_ns = std::max(gc_stats.max_pause_ns, ns);
+	size_t bucket = std::min<size_t>(std::bit_width(ns), gc_pause_buckets - 1);
+	gc_stats.pause_histogram[bucket]++;
+}
+// called at safepoints while a collection is due
+void FaeVM::gc_step() {
+	auto start = std::chrono::steady_clock::now();
+	if(gc_phase == GcPhase::Idle) gc_begin();
+	if(gc_pause_budget_ns == 0) {
+		gc_work(std::chrono::steady_clock::time_point::max());
+	} else {
+		gc_work(start + std::chrono::nanoseconds(gc_pause_budget_ns));
+	}
+	gc_record_pause(start);
 }
-std::ostream &operator<<(std::ostream &os, const Register &v) {
+// finishes the running collection, or does a whole one, in a single pause
+uint64_t FaeVM::collect_garbage() {
+	auto start = std::chrono::steady_clock::now();
+	if(gc_phase == GcPhase::Idle) gc_begin();
+	gc_work(std::chrono::steady_clock::time_point::max());
+	gc_record_pause(start);
+	return gc_cycle_freed;
+}
+
+std::ostream &operator<<(std::ostream &os, const ShowRegister &show) {
+	auto &v = show.reg;
 	size_t vtype = static_cast<size_t>(v.vtype);
 	if(vtype >= variable_type_size) vtype = 0;
 	bool is_open = false;
@@ -3551,12 +5492,8 @@ std::ostream &operator<<(std::ostream &os, const Register &v) {
 			os << "{";
 		}
 	};
-	auto show_ref_counts = [&]() {
-		auto &ptr = v.vm.var_table[v.value];
-		os << ptr.ref_count << ',' << ptr.weak_count << ',';
-	};
 	if(is_vtype_pointer(v.vtype)) {
-		auto &ptr = v.vm.var_table[v.value];
+		auto ptr = v.ptr();
 		if(ptr->get_type() != v.vtype) {
 			open_bracket();
 			os << variable_type_names[vtype] << "!=" << variable_type_names[static_cast<size_t>(ptr->get_type())];
@@ -3572,20 +5509,20 @@ std::ostream &operator<<(std::ostream &os, const Register &v) {
 		break;
 	case VarType::Function: {
 		open_bracket();
-		auto f_ptr = static_cast<VMFunction*>(v.vm.var_table[v.value].get());
+		auto f_ptr = static_cast<VMFunction*>(v.ptr());
 		os << "Fn:" << f_ptr->scope_id;
 		break;
 	}
 	case VarType::Array: {
-		auto o_ptr = static_cast<VMArray*>(v.vm.var_table[v.value].get());
+		auto o_ptr = static_cast<VMArray*>(v.ptr());
 		size_t array_size = o_ptr->values.size();
 		if(array_size == 0) {
 			os << "[]";
 		} else if(array_size > 0 && array_size <= 8) {
-			os << '[' << o_ptr->values.front();
+			os << '[' << ShowRegister{show.vm, o_ptr->values.front()};
 			if(array_size > 0) {
 				std::ranges::for_each(o_ptr->values.cbegin() + 1, o_ptr->values.cend(), [&](auto &array_value) {
-					os << ", " << array_value;
+					os << ", " << ShowRegister{show.vm, array_value};
 				});
 			}
 			os << ']';
@@ -3596,13 +5533,12 @@ std::ostream &operator<<(std::ostream &os, const Register &v) {
 	}
 	case VarType::Object: {
 		open_bracket();
-		auto o_ptr = static_cast<VMObject*>(v.vm.var_table[v.value].get());
-		size_t object_size = o_ptr->values.size();
+		auto o_ptr = static_cast<VMObject*>(v.ptr());
+		size_t object_size = o_ptr->slots.size();
 		if(object_size > 0 && object_size <= 8) {
-			auto itr = o_ptr->values.cbegin();
-			os << v.vm.str_table[itr->first] << " -> " << itr->second;
-			for(;itr != o_ptr->values.cend(); itr++) {
-				os << ", " << v.vm.str_table[itr->first] << " -> " << itr->second;
+			for(uint32_t slot = 0; slot < object_size; slot++) {
+				if(slot > 0) os << ", ";
+				os << show.vm.str_table[o_ptr->shape->name_of(slot)] << " -> " << ShowRegister{show.vm, o_ptr->slots[slot]};
 			}
 		} else {
 			os << "Obj:" << object_size;
@@ -3610,13 +5546,13 @@ std::ostream &operator<<(std::ostream &os, const Register &v) {
 		break;
 	}
 	case VarType::String: {
-		auto o_ptr = static_cast<VMString*>(v.vm.var_table[v.value].get());
-		os << '"' << v.vm.str_table[o_ptr->string_index] << '"';
+		auto o_ptr = static_cast<VMString*>(v.ptr());
+		os << '"' << o_ptr->text() << '"';
 		break;
 	}
 	case VarType::NativeFunction: {
 		open_bracket();
-		auto f_ptr = static_cast<VMNativeFunction*>(v.vm.var_table[v.value].get());
+		auto f_ptr = static_cast<VMNativeFunction*>(v.ptr());
 		os << "NFN:" << *(void**)&f_ptr->native;
 		break;
 	}
@@ -3629,368 +5565,649 @@ std::ostream &operator<<(std::ostream &os, const Register &v) {
 	return os;
 }
 
-FaeTask::FaeTask(FaeVM &vm) : vm{vm}, accumulator(vm) { }
-void FaeTask::enter_frame(std::shared_ptr<FrameContext> context, std::shared_ptr<UpScope> up) {
-	current_frame = std::make_shared<StackFrame>(context, up);
-	current_frame->scope->vars.resize(context->closed_declarations.size(), Register(vm));
-	value_stack.resize(current_frame->first_arg_pos + context->arg_declarations.size(), Register(vm));
+FaeTask::FaeTask(FaeVM &vm) : vm{vm} { }
+// a call costs a scope from the pool and, once frames has grown to the
+// deepest call, no allocation
+void FaeTask::push_frame(FrameContext *context, const ScopeRef &up) {
+	frames.emplace_back(context, vm.scope_pool.take(up, context->closed_declarations.size()));
+	current_frame = &frames.back();
+}
+void FaeTask::enter_frame(FrameContext *context) {
+	frames.clear();
+	push_frame(context, ScopeRef{});
+	value_stack.reserve(current_frame->first_arg_pos + context->arg_declarations.size()
+		+ context->var_declarations.size() + context->max_stack);
+	value_stack.resize(current_frame->first_arg_pos + context->arg_declarations.size(), Register());
 	current_frame->first_var_pos = value_stack.size();
-	value_stack.resize(current_frame->first_var_pos + context->var_declarations.size(), Register(vm));
+	value_stack.resize(current_frame->first_var_pos + context->var_declarations.size(), Register());
 }
 
 ScriptContext::ScriptContext() : vm(std::make_shared<FaeVM>()) {}
 void ScriptContext::LoadScriptFile(const string_view file_path, const string_view into_name) {
 	// load contents of script file at "file_path", put into namespace "into_name"
-	auto dbg_file = std::fstream("./debug.txt", std::ios_base::out | std::ios_base::trunc);
-	auto &dbg = dbg_file;
-	std::string file_source;
-	if(!LoadFileV(file_path, file_source)) return;
-	module_ptr root_module = compile_sourcefile(dbg, std::move(file_source));
-	show_string_table(dbg, *root_module);
-	show_scopes(dbg, *root_module);
+	auto nullout = std::ostream(nullptr);
+	auto &dbg = vm->tracing(TraceLevel::Load) ? *vm->trace_sink : nullout;
+	module_ptr root_module;
+	if(file_path.ends_with(module_image_extension)) {
+		// the image loader only writes rejections
+		root_module = load_module_image(std::cerr, file_path);
+		if(!root_module) return;
+	} else {
+		std::string file_source;
+		if(!LoadFileV(file_path, file_source)) {
+			std::cerr << "could not load: " << file_path << '\n';
+			return;
+		}
+		root_module = compile_sourcefile(dbg, std::move(file_source));
+		if(!root_module) {
+			std::cerr << "could not compile: " << file_path << '\n';
+			return;
+		}
+	}
+	if(vm->tracing(TraceLevel::Load)) {
+		show_string_table(dbg, *root_module);
+		show_scopes(dbg, *root_module);
+	}
 	vm->load_module(file_path, root_module);
 }
 
-void ScriptContext::FunctionCall(const string_view func_name) {
-	FaeVM *vm = this->vm.get();
-	size_t func_str_index = vm->find_string(func_name);
-	auto found = vm->script_map.find(func_str_index);
-	if(found == vm->script_map.cend()) {
-		std::cerr << "Function not found: " << func_name << '\n';
-		return;
-	}
-	auto dbg_file = std::fstream("./debug-run.txt", std::ios_base::out | std::ios_base::trunc);
-	auto &dbg = dbg_file;
-	auto number_of_instructions_run = 0;
-	auto current_module = found->second;
-	auto current_context = current_module->root_context;
-	auto current_instruction = current_context->instructions.cbegin();
-	auto end_of_instructions = current_context->instructions.cend();
+const CompileStats *ScriptContext::GetCompileStats(const string_view module_name) const {
+	auto found = vm->str_index.find(module_name);
+	if(found == vm->str_index.cend()) return nullptr;
+	auto module = vm->script_map.find(found->second);
+	if(module == vm->script_map.cend()) return nullptr;
+	return &module->second->stats;
+}
+
+void ScriptContext::SetExecutionMode(ExecutionMode mode) {
+	vm->execution_mode = mode;
+}
+
+void ScriptContext::SetFuel(uint64_t fuel) {
+	vm->current_task->fuel = fuel;
+}
+uint64_t ScriptContext::GetFuel() const {
+	return vm->current_task->fuel;
+}
+
+void ScriptContext::SetCollectorTrigger(uint64_t min_bytes, uint32_t growth_percent) {
+	vm->set_collector_trigger(min_bytes, growth_percent);
+}
+void ScriptContext::SetPauseBudget(uint64_t pause_budget_ns) {
+	vm->gc_pause_budget_ns = pause_budget_ns;
+}
+uint64_t ScriptContext::CollectGarbage() {
+	return vm->collect_garbage();
+}
+const GcStats &ScriptContext::GetGcStats() const {
+	return vm->gc_stats;
+}
+
+void ScriptContext::SetTrace(TraceLevel level, std::ostream *sink) {
+	vm->trace_level = sink ? level : TraceLevel::Off;
+	vm->trace_sink = sink;
+}
+
+// threaded dispatch: every handler ends by fetching and jumping to the next
+// handler itself, through a label table generated from DEF_OPCODES.
+// Needs labels as values, other compilers use the switch.
+#if !defined(FAE_THREADED_DISPATCH)
+#if defined(__GNUC__) || defined(__clang__)
+#define FAE_THREADED_DISPATCH 1
+#else
+#define FAE_THREADED_DISPATCH 0
+#endif
+#endif
+
+#define FAE_FETCH() \
+	next_instruction = decode_instruction(current_instruction, decoded); \
+	param = decoded.param; \
+	dbg << "EXEC: [" << current_instruction - first_instruction << "]" << decoded << '\n'
+#if FAE_THREADED_DISPATCH
+#define FAE_CASE(name) case Opcode::name: op_##name
+#define FAE_CASE_DEFAULT default: op_invalid
+#define FAE_DISPATCH() do { \
+		if(current_instruction == end_of_instructions) goto next_frame; \
+		FAE_FETCH(); \
+		if(checked && static_cast<size_t>(decoded.opcode) >= std::size(handlers)) goto op_invalid; \
+		goto *handlers[static_cast<size_t>(decoded.opcode)]; \
+	} while(0)
+#else
+#define FAE_CASE(name) case Opcode::name
+#define FAE_CASE_DEFAULT default
+#define FAE_DISPATCH() goto next_frame
+#endif
+#define FAE_NEXT() do { \
+		current_instruction = next_instruction; \
+		FAE_DISPATCH(); \
+	} while(0)
+// fuel is only charged at calls and backward jumps, which are also the
+// safepoints where a pending collection runs and zero count objects are
+// freed. an exhausted task saves the charging instruction so resuming
+// runs it again. the first charge after a resume always passes, taking
+// what fuel is left, so a budget below the cost of one charge still progresses
+#define FAE_CHARGE(cost) do { \
+		if(vm->gc_pending) vm->gc_step(); \
+		if(vm->zct.entries.size() >= vm->zct_limit) vm->reconcile_counts(); \
+		if(task->fuel < (cost) && !resumed) { \
+			task->current_frame->current_instruction = current_instruction; \
+			calls << "out of fuel in frame: " << current_context->frame_index \
+				<< " ins " << (current_instruction - first_instruction) << '\n'; \
+			return RunStatus::OutOfFuel; \
+		} \
+		task->fuel -= std::min<uint64_t>(task->fuel, (cost)); \
+		resumed = false; \
+	} while(0)
+// a backward jump costs the code words it loops over
+#define FAE_JUMP() do { \
+		if(first_instruction + param <= current_instruction) \
+			FAE_CHARGE(static_cast<uint64_t>(current_instruction - first_instruction) - param + 1); \
+		current_instruction = first_instruction + param; \
+		FAE_DISPATCH(); \
+	} while(0)
+
+// checked is false only for verified modules, the skipped checks are
+// the ones verify_module already proved for every path through the code
+template<bool checked>
+static RunStatus run_module(FaeVM *vm, module_ptr current_module, bool resume) {
+	auto err = vm->errors();
+	auto calls = vm->trace(TraceLevel::Calls);
+	auto dbg = vm->trace(TraceLevel::Instructions);
+	auto values = vm->trace(TraceLevel::Values);
 	auto task = vm->current_task.get();
-	task->enter_frame(current_context, std::shared_ptr<UpScope>());
-	for(auto &import_ptr : current_module->imports) {
-		auto import_sv = string_view(import_ptr->var_name);
-		size_t string_index = vm->find_string(import_sv);
-		auto import_itr = vm->imports_table.find(string_index);
-		if(import_itr == vm->imports_table.cend()) {
-			dbg << "import not found: " << import_sv << '\n';
-			return;
-		} else {
-			task->current_frame->scope->vars[import_ptr->pos] = import_itr->second;
+	bool resumed = resume;
+	FrameContext *current_context = resume ? task->current_frame->context : current_module->root_context.get();
+	const uint32_t *first_instruction = current_context->code.data();
+	const uint32_t *current_instruction = resume ? task->current_frame->current_instruction : first_instruction;
+	const uint32_t *end_of_instructions = first_instruction + current_context->code.size();
+	const uint32_t *next_instruction = current_instruction;
+	Instruction decoded{Opcode::LoadUnit};
+	const Instruction *ins = &decoded;
+	uint64_t param = 0;
+#if FAE_THREADED_DISPATCH
+	static const void *const handlers[] = {
+#define GENERATE(f) &&op_##f,
+		DEF_OPCODES(GENERATE)
+#undef GENERATE
+	};
+#endif
+	auto type_name = [](const Register &r) {
+		return variable_type_names[static_cast<size_t>(r.vtype)];
+	};
+	// guarded opcodes check their operands, then share the unchecked implementation
+	auto check_integers = [&](Opcode op) {
+		if(checked && task->value_stack.empty()) {
+			err << "stack underflow: " << op << '\n';
+			return false;
+		}
+		auto &left = task->value_stack.back();
+		if(left.vtype == VarType::Integer && task->accumulator.vtype == VarType::Integer) return true;
+		err << "type error: " << op << " on " << type_name(left)
+			<< " and " << type_name(task->accumulator) << '\n';
+		return false;
+	};
+	if(!resume) {
+		task->enter_frame(current_context);
+		for(auto &import_ptr : current_module->imports) {
+			auto import_sv = string_view(import_ptr->var_name);
+			size_t string_index = vm->find_string(import_sv);
+			auto import_itr = vm->imports_table.find(string_index);
+			if(import_itr == vm->imports_table.cend()) {
+				err << "import not found: " << import_sv << '\n';
+				return RunStatus::Error;
+			} else {
+				task->current_frame->scope->vars[import_ptr->pos] = import_itr->second;
+			}
 		}
 	}
 	for(;;) {
+	next_frame:
 		if(current_instruction == end_of_instructions) {
-			if(!task->scope_stack.empty()) {
-				task->show_vars(dbg);
-				task->value_stack.resize(task->current_frame->first_var_pos, Register(*vm));
-				auto next_scope = std::move(task->scope_stack.back());
-				task->scope_stack.pop_back();
-				current_instruction = next_scope->current_instruction;
-				end_of_instructions = next_scope->context->instructions.cend();
-				current_context = next_scope->context;
-				task->current_frame = std::move(next_scope);
-				dbg << "Exit to frame: " << current_context->frame_index
-					<< " ins " << (current_instruction - current_context->instructions.cbegin())
-					<< "/" << current_context->instructions.size() << '\n';
-				task->show_vars(dbg);
-				current_instruction++;
+			if(task->frames.size() > 1) {
+				task->show_vars(values);
+				task->value_stack.truncate(task->current_frame->end_arg_pos);
+				task->pop_frame();
+				current_instruction = task->current_frame->current_instruction;
+				current_context = task->current_frame->context;
+				first_instruction = current_context->code.data();
+				end_of_instructions = first_instruction + current_context->code.size();
+				calls << "Exit to frame: " << current_context->frame_index
+					<< " ins " << (current_instruction - current_context->code.data())
+					<< "/" << current_context->code.size() << '\n';
+				task->show_vars(values);
 				continue;
 			}
 			break;
 		}
-		auto &ins = current_instruction;
-		auto param = current_instruction->param;
-		auto first_instruction = current_context->instructions.cbegin();
-		dbg << "EXEC: [" << current_instruction - first_instruction << "]" << *current_instruction << '\n';
-		switch(current_instruction->opcode) {
-		case Opcode::ExitFunction: {
+		FAE_FETCH();
+#if FAE_THREADED_DISPATCH
+		if(checked && static_cast<size_t>(decoded.opcode) >= std::size(handlers)) goto op_invalid;
+		goto *handlers[static_cast<size_t>(decoded.opcode)];
+#endif
+		switch(decoded.opcode) {
+		FAE_CASE(ExitFunction): {
 			current_instruction = end_of_instructions;
-			continue;
-		}
-		case Opcode::CallExpression: {
-			size_t var_index = task->accumulator.value;
-			if((task->accumulator.vtype != VarType::Function
-					&& task->accumulator.vtype != VarType::NativeFunction)
-				|| var_index >= vm->var_table.size()) {
-				dbg << "call to non-function value\n";
-				task->show_vars(dbg);
-				return;
+			FAE_DISPATCH();
+		}
+		FAE_CASE(CallExpression): {
+			FAE_CHARGE(1);
+			if(task->accumulator.vtype != VarType::Function
+				&& task->accumulator.vtype != VarType::NativeFunction) {
+				err << "call to non-function value\n";
+				task->show_vars(values);
+				return RunStatus::Error;
 			}
-			auto &func_var = vm->var_table[var_index];
+			auto func_var = task->accumulator.ptr();
 			if(func_var->get_type() == VarType::NativeFunction) {
-				auto func_ptr = static_cast<VMNativeFunction*>(func_var.get());
-				task->show_vars(dbg);
+				auto func_ptr = static_cast<VMNativeFunction*>(func_var);
+				task->show_vars(values);
 				func_ptr->native(*task);
-				task->show_vars(dbg);
-				break;
+				task->show_vars(values);
+				FAE_NEXT();
 			}
 			if(func_var->get_type() != VarType::Function) {
-				dbg << "broken function reference\n";
-				task->show_vars(dbg);
-				return;
+				err << "broken function reference\n";
+				task->show_vars(values);
+				return RunStatus::Error;
 			}
-			auto func_ptr = static_cast<VMFunction*>(func_var.get());
+			auto func_ptr = static_cast<VMFunction*>(func_var);
 			size_t frame_index = func_ptr->scope_id;
-			if(frame_index >= current_module->frames.size()) {
-				dbg << "call to non-existant function value\n";
-				task->show_vars(dbg);
-				return;
+			if(checked && frame_index >= current_module->frames.size()) {
+				err << "call to non-existant function value\n";
+				task->show_vars(values);
+				return RunStatus::Error;
 			}
-			auto closure_frame_ptr = func_ptr->up;
-			auto next_context = current_module->frames[frame_index];
-			task->current_frame->current_instruction = current_instruction;
-			auto prev_frame = task->current_frame.get();
-			task->scope_stack.push_back(task->current_frame);
-			task->current_frame = std::make_shared<StackFrame>(next_context, closure_frame_ptr);
-			task->current_frame->scope->vars.resize(next_context->closed_declarations.size(), Register(*vm));
+			auto next_context = current_module->frames[frame_index].get();
+			task->current_frame->current_instruction = next_instruction;
 			// take the argument's values from the stack
 			// and actually give them to the function
 			size_t end_prev_frame_vars =
-				prev_frame->first_var_pos + prev_frame->context->var_declarations.size();
+				task->current_frame->first_var_pos + current_context->var_declarations.size();
+			task->push_frame(next_context, func_ptr->up);
 			size_t stack_size = task->value_stack.size();
-			if(param > stack_size) {
-				dbg << "stack underflow!\n";
-				return;
-			}
-			if(end_prev_frame_vars > stack_size) {
-				dbg << "the value stack is broken!\n";
-				return;
-			}
-			if(param > stack_size - end_prev_frame_vars) {
-				dbg << "stack underflow!\n";
-				return;
+			if constexpr(checked) {
+				if(param > stack_size) {
+					err << "stack underflow!\n";
+					return RunStatus::Error;
+				}
+				if(end_prev_frame_vars > stack_size) {
+					err << "the value stack is broken!\n";
+					return RunStatus::Error;
+				}
+				if(param > stack_size - end_prev_frame_vars) {
+					err << "stack underflow!\n";
+					return RunStatus::Error;
+				}
 			}
 			task->current_frame->first_arg_pos = stack_size - param;
+			task->current_frame->end_arg_pos = stack_size;
+			// the one place the stack may grow: padding, locals and operands of the callee
+			size_t padding = param < next_context->arg_declarations.size()
+				? next_context->arg_declarations.size() - param : 0;
+			task->value_stack.reserve(stack_size + padding
+				+ next_context->var_declarations.size() + next_context->max_stack);
+			// missing arguments are Unit, so argument slots are always in range
+			if(padding > 0) {
+				stack_size += padding;
+				task->value_stack.resize(stack_size, Register(0, VarType::Unit));
+			}
 			task->current_frame->first_var_pos = stack_size;
-			task->value_stack.resize(stack_size + next_context->var_declarations.size(), Register(*vm));
-			current_instruction = next_context->instructions.cbegin();
-			end_of_instructions = next_context->instructions.cend();
+			task->value_stack.resize(stack_size + next_context->var_declarations.size(), Register());
+			current_instruction = next_context->code.data();
+			end_of_instructions = current_instruction + next_context->code.size();
 			current_context = next_context;
-			task->show_args(dbg);
-			task->show_vars(dbg);
-			continue;
+			first_instruction = current_instruction;
+			task->show_args(values);
+			task->show_vars(values);
+			FAE_DISPATCH();
 		}
-		case Opcode::LoadClosure: {
-			dbg << "load closure: " << param << " capture scope variables\n";
+		FAE_CASE(LoadClosure): {
+			calls << "load closure: " << param << " capture scope variables\n";
 			// param is scope_id
-			size_t current_var = vm->var_table.size();
-			vm->var_table.emplace_back(new VMFunction{task->current_frame->scope, param});
-			task->accumulator = Register{*vm, current_var, VarType::Function};
-			task->show_accum(dbg);
-			break;
+			task->accumulator = vm->put_variable(new VMFunction{task->current_frame->scope, param});
+			task->show_accum(values);
+			FAE_NEXT();
 		}
-		case Opcode::LoadNewArray: {
+		FAE_CASE(LoadNewArray): {
 			dbg << "new array\n";
 			VMArray *array_var = new VMArray{};
 			if(param > 0) {
 				array_var->values.reserve(param);
-				if(param > task->var_stack_size()) {
-					dbg << "NewArray: stack underflow!\n";
-					return;
+				if(checked && param > task->var_stack_size()) {
+					err << "NewArray: stack underflow!\n";
+					return RunStatus::Error;
 				}
 				auto stack_end = task->value_stack.end();
 				auto stack_first = stack_end - param;
 				auto stack_itr = stack_first;
 				for(;stack_itr != stack_end; stack_itr++) {
-					array_var->values.emplace_back(std::move(*stack_itr));
+					array_var->values.emplace_back(*stack_itr);
 				}
-				task->value_stack.erase(stack_first, stack_end);
+				task->value_stack.truncate(task->value_stack.size() - param);
 			}
 			task->accumulator = vm->put_variable(array_var);
-			task->show_accum(dbg);
-			break;
+			task->show_accum(values);
+			FAE_NEXT();
+		}
+		FAE_CASE(NewObjectFromTemplate): {
+			if(checked && param >= current_module->object_templates.size()) {
+				err << "object template out of bounds\n";
+				return RunStatus::Error;
+			}
+			auto &tpl = current_module->object_templates[param];
+			size_t count = tpl.names.size();
+			dbg << "new object from template: " << count << " members\n";
+			if(checked && count > task->var_stack_size()) {
+				err << "NewObjectFromTemplate: stack underflow!\n";
+				return RunStatus::Error;
+			}
+			VMObject *obj_var = new VMObject{tpl.shape};
+			obj_var->slots.reserve(count);
+			auto stack_end = task->value_stack.end();
+			for(auto stack_itr = stack_end - count; stack_itr != stack_end; stack_itr++) {
+				obj_var->slots.emplace_back(*stack_itr);
+			}
+			task->value_stack.truncate(task->value_stack.size() - count);
+			task->accumulator = vm->put_variable(obj_var);
+			task->show_accum(values);
+			FAE_NEXT();
 		}
-		case Opcode::LoadNewObject: {
+		FAE_CASE(LoadNewObject): {
 			dbg << "new object\n";
-			task->accumulator = vm->put_variable(new VMObject{});
-			task->show_accum(dbg);
-			break;
+			task->accumulator = vm->put_variable(new VMObject{&vm->empty_shape});
+			task->show_accum(values);
+			FAE_NEXT();
 		}
-		case Opcode::AssignNamed: {
-			if(task->value_stack.empty()) {
-				dbg << "AssignNamed: value stack empty!\n";
-				return;
+		FAE_CASE(AssignNamed): {
+			if(checked && task->value_stack.empty()) {
+				err << "AssignNamed: value stack empty!\n";
+				return RunStatus::Error;
 			}
 			Register &obj = task->value_stack.back();
 			if(obj.vtype != VarType::Object
-				|| obj.value > vm->var_table.size()
-				|| vm->var_table[obj.value]->get_type() != VarType::Object
+				|| obj.ptr()->get_type() != VarType::Object
 				) {
-				dbg << "AssignNamed: \"" << vm->str_table[param] << "\" on bad object: " << obj << "\n";
-				return;
+				err << "AssignNamed: \"" << vm->str_table[param] << "\" on bad object: " << ShowRegister{*vm, obj} << "\n";
+				return RunStatus::Error;
 			}
-			auto obj_pointer = static_cast<VMObject*>(vm->var_table[obj.value].get());
-			auto value_itr = obj_pointer->values.find(param);
+			auto obj_pointer = static_cast<VMObject*>(obj.ptr());
 			dbg << "AssignNamed \"" << vm->str_table[param] << "\"\n";
-			if(value_itr == obj_pointer->values.end()) {
-				obj_pointer->values.emplace(param, std::move(task->accumulator));
+			vm->write_barrier(task->accumulator);
+			if(auto slot = obj_pointer->find(param)) {
+				*slot = task->accumulator;
 			} else {
-				value_itr->second = std::move(task->accumulator);
+				obj_pointer->add(param, task->accumulator);
 			}
-			task->show_vars(dbg);
-			break;
+			// the value moved into the object
+			task->accumulator = Register();
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::NamedLookup: {
+		FAE_CASE(NamedLookup): {
 			if(task->accumulator.vtype != VarType::Object
-				|| task->accumulator.value > vm->var_table.size()
-				|| vm->var_table[task->accumulator.value]->get_type() != VarType::Object
+				|| task->accumulator.ptr()->get_type() != VarType::Object
 				) {
-				dbg << "invalid named lookup: \"" << vm->str_table[param] << "\" on object: " << task->accumulator << "\n";
-				return;
+				err << "invalid named lookup: \"" << vm->str_table[param] << "\" on object: " << ShowRegister{*vm, task->accumulator} << "\n";
+				return RunStatus::Error;
 			}
-			dbg << "named lookup: \"" << vm->str_table[param] << "\" is still TODO\n";
-			auto obj_pointer = static_cast<VMObject*>(vm->var_table[task->accumulator.value].get());
-			auto value_itr = obj_pointer->values.find(param);
-			if(value_itr == obj_pointer->values.end()) {
+			auto obj_pointer = static_cast<VMObject*>(task->accumulator.ptr());
+			auto slot = obj_pointer->find(param);
+			if(!slot) {
 				dbg << "named lookup \"" << vm->str_table[param] << "\" is not present on object\n";
-				task->accumulator = Register(*vm);
-				task->show_vars(dbg);
-				break;
+				task->accumulator = Register();
+				task->show_vars(values);
+				FAE_NEXT();
 			}
-			task->accumulator = value_itr->second;
-			task->show_vars(dbg);
-			break;
+			task->accumulator = *slot;
+			task->show_vars(values);
+			FAE_NEXT();
+		}
+		FAE_CASE(AssignNamedSite): {
+			if(checked && param >= current_module->named_sites.size()) {
+				err << "named site out of bounds\n";
+				return RunStatus::Error;
+			}
+			auto &site = current_module->named_sites[param];
+			if(checked && task->value_stack.empty()) {
+				err << "AssignNamed: value stack empty!\n";
+				return RunStatus::Error;
+			}
+			Register &obj = task->value_stack.back();
+			if(obj.vtype != VarType::Object
+				|| obj.ptr()->get_type() != VarType::Object
+				) {
+				err << "AssignNamed: \"" << vm->str_table[site.name] << "\" on bad object: " << ShowRegister{*vm, obj} << "\n";
+				return RunStatus::Error;
+			}
+			auto obj_pointer = static_cast<VMObject*>(obj.ptr());
+			dbg << "AssignNamed \"" << vm->str_table[site.name] << "\"\n";
+			InlineCache::Entry hit;
+			if(auto cached = site.cache.find(obj_pointer->shape)) {
+				hit = *cached;
+			} else {
+				dbg << "inline cache miss\n";
+				hit = InlineCache::Entry{obj_pointer->shape, nullptr, obj_pointer->shape->find(site.name)};
+				if(hit.slot == Shape::no_slot) {
+					hit.next = obj_pointer->shape->add(site.name);
+					hit.slot = static_cast<uint32_t>(obj_pointer->slots.size());
+				}
+				site.cache.record(hit);
+			}
+			vm->write_barrier(task->accumulator);
+			if(hit.next) {
+				obj_pointer->shape = hit.next;
+				obj_pointer->slots.emplace_back(task->accumulator);
+			} else {
+				obj_pointer->slots[hit.slot] = task->accumulator;
+			}
+			// the value moved into the object
+			task->accumulator = Register();
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::NamedArgLookup: {
+		FAE_CASE(NamedLookupSite): {
+			if(checked && param >= current_module->named_sites.size()) {
+				err << "named site out of bounds\n";
+				return RunStatus::Error;
+			}
+			auto &site = current_module->named_sites[param];
+			if(task->accumulator.vtype != VarType::Object
+				|| task->accumulator.ptr()->get_type() != VarType::Object
+				) {
+				err << "invalid named lookup: \"" << vm->str_table[site.name] << "\" on object: " << ShowRegister{*vm, task->accumulator} << "\n";
+				return RunStatus::Error;
+			}
+			auto obj_pointer = static_cast<VMObject*>(task->accumulator.ptr());
+			uint32_t slot;
+			if(auto cached = site.cache.find(obj_pointer->shape)) {
+				slot = cached->slot;
+			} else {
+				dbg << "inline cache miss\n";
+				slot = obj_pointer->shape->find(site.name);
+				if(slot == Shape::no_slot) {
+					dbg << "named lookup \"" << vm->str_table[site.name] << "\" is not present on object\n";
+					task->accumulator = Register();
+					task->show_vars(values);
+					FAE_NEXT();
+				}
+				site.cache.record(InlineCache::Entry{obj_pointer->shape, nullptr, slot});
+			}
+			task->accumulator = obj_pointer->slots[slot];
+			task->show_vars(values);
+			FAE_NEXT();
+		}
+		FAE_CASE(NamedArgLookup): {
 			if(task->accumulator.vtype != VarType::Integer
 				|| task->accumulator.value >= task->current_frame->first_var_pos - task->current_frame->first_arg_pos) {
-				dbg << "arg ref: bad time or number";
-				return;
+				err << "arg ref: bad time or number\n";
+				return RunStatus::Error;
 			}
 			task->accumulator = task->value_stack[task->current_frame->first_arg_pos + task->accumulator.value];
-			task->show_accum(dbg);
-			break;
+			task->show_accum(values);
+			FAE_NEXT();
 		}
-		case Opcode::LoadConst:
-			task->accumulator = Register{*vm, param};
-			break;
-		case Opcode::LoadString:
-			task->accumulator = vm->put_variable(new VMString(param));
-			break;
-		case Opcode::LoadVariable: {
-			uint32_t up_count = ins->param_a;
-			dbg << "load variable: " << up_count << "," << ins->param_b << ": ";
-			auto search_context = task->current_frame->scope.get();
-			for(;up_count != 0; up_count--) {
-				search_context = search_context->up.get();
-				if(search_context == nullptr) {
-					dbg << "frame depth error\n";
-					return;
-				}
+		FAE_CASE(LoadConst):
+			task->accumulator = Register{param};
+			FAE_NEXT();
+		FAE_CASE(LoadString):
+			task->accumulator = vm->put_variable(new VMInternedString(param, vm->string_text(param)));
+			FAE_NEXT();
+		FAE_CASE(LoadConstRef):
+			if(checked && param >= current_module->constants.size()) {
+				err << "constant reference out of bounds\n";
+				return RunStatus::Error;
 			}
-			if(ins->param_b >= search_context->vars.size()) {
-				dbg << "reference out of bounds\n";
-				return;
+			task->accumulator = current_module->constants[param];
+			FAE_NEXT();
+		FAE_CASE(LoadVariable): {
+			dbg << "load variable: " << ins->param_a << "," << ins->param_b << ": ";
+			auto scope = task->current_frame->scope.get();
+			if(checked && ins->param_a > scope->depth) {
+				err << "frame depth error\n";
+				return RunStatus::Error;
+			}
+			auto search_context = scope->scope_up(ins->param_a);
+			if(checked && ins->param_b >= search_context->vars.size()) {
+				err << "reference out of bounds\n";
+				return RunStatus::Error;
 			}
 			// found variable case
 			task->accumulator = search_context->vars[ins->param_b];
-			task->show_accum(dbg);
-			break;
+			task->show_accum(values);
+			FAE_NEXT();
 		}
-		case Opcode::StoreVariable: {
-			uint32_t up_count = ins->param_a;
-			dbg << "store variable: " << up_count << "," << ins->param_b << ": ";
-			auto search_context = task->current_frame->scope.get();
-			for(;up_count != 0; up_count--) {
-				search_context = search_context->up.get();
-				if(search_context == nullptr) {
-					dbg << "frame depth error\n";
-					return;
-				}
+		FAE_CASE(StoreVariable): {
+			dbg << "store variable: " << ins->param_a << "," << ins->param_b << ": ";
+			auto scope = task->current_frame->scope.get();
+			if(checked && ins->param_a > scope->depth) {
+				err << "frame depth error\n";
+				return RunStatus::Error;
 			}
-			if(ins->param_b >= search_context->vars.size()) {
-				dbg << "reference out of bounds\n";
-				return;
+			auto search_context = scope->scope_up(ins->param_a);
+			if(checked && ins->param_b >= search_context->vars.size()) {
+				err << "reference out of bounds\n";
+				return RunStatus::Error;
 			}
 			// found variable case
+			vm->write_barrier(task->accumulator);
 			search_context->vars[ins->param_b] = task->accumulator;
-			task->show_vars(dbg);
-			break;
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::LoadLocal: {
+		FAE_CASE(LoadLocal): {
 			size_t pos = task->current_frame->first_var_pos + ins->param_b;
 			dbg << "load local: " << pos << "," << ins->param_b << ": ";
-			if(pos >= task->value_stack.size()) {
-				dbg << "reference out of bounds\n";
-				return;
+			if(checked && pos >= task->value_stack.size()) {
+				err << "reference out of bounds\n";
+				return RunStatus::Error;
 			}
 			task->accumulator = task->value_stack[pos];
-			task->show_args(dbg);
-			task->show_accum(dbg);
-			break;
+			task->show_args(values);
+			task->show_accum(values);
+			FAE_NEXT();
 		}
-		case Opcode::StoreLocal: {
+		FAE_CASE(StoreLocal): {
 			uint32_t pos = task->current_frame->first_var_pos + ins->param_b;
 			dbg << "assign local variable: [" << pos << "]" << '\n';
-			if(pos >= task->value_stack.size()) {
-				task->value_stack.resize(pos + 1, Register{*vm});
+			if(checked && pos >= task->value_stack.size()) {
+				task->value_stack.resize(pos + 1, Register{});
 			}
-			task->value_stack.at(pos) = task->accumulator;
-			task->show_vars(dbg);
-			break;
+			task->value_stack[pos] = task->accumulator;
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::LoadArg: {
+		FAE_CASE(LoadArg): {
 			uint32_t pos = task->current_frame->first_arg_pos + ins->param_b;
 			dbg << "load arg: " << task->current_frame->first_arg_pos << "+" << ins->param_b << ": ";
-			if(pos >= task->value_stack.size()) {
-				task->accumulator = Register{*vm};
+			if(checked && pos >= task->value_stack.size()) {
+				task->accumulator = Register{};
 			} else {
 				task->accumulator = task->value_stack[pos];
 			}
-			task->show_args(dbg);
-			task->show_accum(dbg);
-			break;
+			task->show_args(values);
+			task->show_accum(values);
+			FAE_NEXT();
 		}
-		case Opcode::PushRegister:
+		FAE_CASE(PushRegister):
+			// only reached when max_stack was wrong, the verifier rejects that
+			if(checked && task->value_stack.full()) {
+				err << "stack overflow: " << ins->opcode << '\n';
+				return RunStatus::Error;
+			}
 			task->value_stack.push_back(task->accumulator);
-			task->show_vars(dbg);
-			break;
-		case Opcode::PopRegister:
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(PopRegister):
 			task->accumulator = task->pop_value();
-			task->show_vars(dbg);
-			break;
-		case Opcode::PopStack: {
-			auto begin = task->value_stack.cend() - 1 - param;
-			task->value_stack.erase(begin, task->value_stack.cend());
-			task->show_vars(dbg);
-			break;
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(PopStack): {
+			task->value_stack.truncate(task->value_stack.size() - 1 - param);
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::LoadStack:
-			if(param >= task->value_stack.size()) {
-				task->accumulator = Register{*vm};
+		FAE_CASE(LoadStack):
+			if(checked && param >= task->value_stack.size()) {
+				task->accumulator = Register{};
 			} else {
-				task->accumulator = *(task->value_stack.crbegin() + param);
+				task->accumulator = task->value_stack.from_top(param);
 			}
-			break;
-		case Opcode::StoreStack:
-			if(param < task->value_stack.size()) {
-				*(task->value_stack.rbegin() + param) = task->accumulator;
+			FAE_NEXT();
+		FAE_CASE(StoreStack):
+			if(!checked || param < task->value_stack.size()) {
+				task->value_stack.from_top(param) = task->accumulator;
 			}
-			break;
-		case Opcode::AddInteger:
-			task->accumulator = Register{*vm, task->pop_value().value + task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::SubInteger:
-			task->accumulator = Register{*vm, task->pop_value().value - task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::MulInteger:
-			task->accumulator = Register{*vm,
+			FAE_NEXT();
+		FAE_CASE(Add):
+			// the guarded add also joins two strings
+			if((!checked || !task->value_stack.empty())
+				&& task->value_stack.back().vtype == VarType::String
+				&& task->accumulator.vtype == VarType::String) {
+				auto head = task->pop_value();
+				task->accumulator = vm->concat_strings(head, task->accumulator);
+				task->show_vars(values);
+				FAE_NEXT();
+			}
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(AddInteger):
+			task->accumulator = Register{task->pop_value().value + task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(Sub):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(SubInteger):
+			task->accumulator = Register{task->pop_value().value - task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(Mul):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(MulInteger):
+			task->accumulator = Register{
 				static_cast<int64_t>(task->pop_value().value)
 				* static_cast<int64_t>(task->accumulator.value)};
-			task->show_vars(dbg);
-			break;
-		case Opcode::DivInteger:
-			task->accumulator = Register{*vm, task->pop_value().value / task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::ModInteger:
-			task->accumulator = Register{*vm, task->pop_value().value % task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::PowInteger: {
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(Div):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(DivInteger):
+			task->accumulator = Register{task->pop_value().value / task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(Mod):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(ModInteger):
+			task->accumulator = Register{task->pop_value().value % task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(Pow):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(PowInteger): {
 			int64_t ex = static_cast<int64_t>(task->accumulator.value);
 			int64_t left = task->pop_value().value;
 			int64_t result = 0;
@@ -4006,121 +6223,269 @@ void ScriptContext::FunctionCall(const string_view func_name) {
 					ex >>= 1;
 				}
 			}
-			task->accumulator = Register{*vm, result};
-			task->show_vars(dbg);
-			break;
+			task->accumulator = Register{result};
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::Negate:
-			task->accumulator = Register{*vm, -static_cast<int64_t>(task->accumulator.value)};
-			task->show_accum(dbg);
-			break;
-		case Opcode::OrInteger:
-			task->accumulator = Register{*vm, task->pop_value().value | task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::AndInteger:
-			task->accumulator = Register{*vm, task->pop_value().value & task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::XorInteger:
-			task->accumulator = Register{*vm, task->pop_value().value ^ task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::RSHLInteger:
-			task->accumulator = Register{*vm, task->pop_value().value >> task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::RSHAInteger:
+		FAE_CASE(SquareInteger):
+			task->accumulator = Register{
+				static_cast<int64_t>(task->accumulator.value)
+				* static_cast<int64_t>(task->accumulator.value)};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(MulStackInteger):
+			task->accumulator = Register{
+				static_cast<int64_t>(task->value_stack.back().value)
+				* static_cast<int64_t>(task->accumulator.value)};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(MulConstInteger):
+			task->accumulator = Register{task->accumulator.value * param};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(LSHConstInteger):
+			task->accumulator = Register{task->accumulator.value << param};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(RSHLConstInteger):
+			task->accumulator = Register{task->accumulator.value >> param};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(AndConstInteger):
+			task->accumulator = Register{task->accumulator.value & param};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(DivMagicInteger):
+			task->accumulator = Register{
+				divide_magic(current_module->divisor_table[param], task->accumulator.value)};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(ModMagicInteger): {
+			auto &magic = current_module->divisor_table[param];
+			uint64_t dividend = task->accumulator.value;
+			task->accumulator = Register{
+				dividend - divide_magic(magic, dividend) * magic.divisor};
+			task->show_accum(values);
+			FAE_NEXT();
+		}
+		FAE_CASE(Negate):
+			if(task->accumulator.vtype != VarType::Integer) {
+				err << "type error: " << ins->opcode << " on " << type_name(task->accumulator) << '\n';
+				return RunStatus::Error;
+			}
+			[[fallthrough]];
+		FAE_CASE(NegateInteger):
+			task->accumulator = Register{-static_cast<int64_t>(task->accumulator.value)};
+			task->show_accum(values);
+			FAE_NEXT();
+		FAE_CASE(GuardInteger):
+			if(task->accumulator.vtype != VarType::Integer) {
+				err << "type error: expected Integer, got " << type_name(task->accumulator) << '\n';
+				return RunStatus::Error;
+			}
+			FAE_NEXT();
+		FAE_CASE(And):
+		FAE_CASE(Or):
+		FAE_CASE(Xor): {
+			// integers or bools, never mixed
+			if(checked && task->value_stack.empty()) {
+				err << "stack underflow: " << ins->opcode << '\n';
+				return RunStatus::Error;
+			}
+			auto lh = task->pop_value();
+			auto rh = task->accumulator.value;
+			if(lh.vtype != task->accumulator.vtype
+					|| (lh.vtype != VarType::Integer && lh.vtype != VarType::Bool)) {
+				err << "type error: " << ins->opcode << " on " << type_name(lh)
+					<< " and " << type_name(task->accumulator) << '\n';
+				return RunStatus::Error;
+			}
+			uint64_t result = ins->opcode == Opcode::And ? lh.value & rh
+				: ins->opcode == Opcode::Or ? lh.value | rh : lh.value ^ rh;
+			task->accumulator = Register{result, lh.vtype};
+			task->show_vars(values);
+			FAE_NEXT();
+		}
+		FAE_CASE(AndBool):
+			task->accumulator = Register{task->pop_value().value & task->accumulator.value, VarType::Bool};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(OrBool):
+			task->accumulator = Register{task->pop_value().value | task->accumulator.value, VarType::Bool};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(XorBool):
+			task->accumulator = Register{task->pop_value().value ^ task->accumulator.value, VarType::Bool};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(OrInteger):
+			task->accumulator = Register{task->pop_value().value | task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(AndInteger):
+			task->accumulator = Register{task->pop_value().value & task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(XorInteger):
+			task->accumulator = Register{task->pop_value().value ^ task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(RSHL):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(RSHLInteger):
+			task->accumulator = Register{task->pop_value().value >> task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(RSHA):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(RSHAInteger):
 			task->accumulator =
-				Register{*vm, static_cast<int64_t>(task->pop_value().value)
+				Register{static_cast<int64_t>(task->pop_value().value)
 				>> task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::LSHInteger:
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(LSH):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(LSHInteger):
 			task->accumulator =
-				Register{*vm, task->pop_value().value << task->accumulator.value};
-			task->show_vars(dbg);
-			break;
-		case Opcode::CompareLess:
-			task->accumulator = Register{*vm,
+				Register{task->pop_value().value << task->accumulator.value};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(CompareLess):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(CompareLessInteger):
+			task->accumulator = Register{
 				task->pop_value().value < task->accumulator.value
 				? uint64_t{1} : uint64_t{0}
 				, VarType::Bool};
-			task->show_vars(dbg);
-			break;
-		case Opcode::CompareGreater:
-			task->accumulator = Register{*vm,
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(CompareGreater):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(CompareGreaterInteger):
+			task->accumulator = Register{
 				task->pop_value().value > task->accumulator.value
 				? uint64_t{1} : uint64_t{0}
 				, VarType::Bool};
-			task->show_vars(dbg);
-			break;
-		case Opcode::CompareNotEqual: {
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(CompareLessEqual):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(CompareLessEqualInteger):
+			task->accumulator = Register{
+				task->pop_value().value <= task->accumulator.value
+				? uint64_t{1} : uint64_t{0}
+				, VarType::Bool};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(CompareGreaterEqual):
+			if(!check_integers(ins->opcode)) return RunStatus::Error;
+			[[fallthrough]];
+		FAE_CASE(CompareGreaterEqualInteger):
+			task->accumulator = Register{
+				task->pop_value().value >= task->accumulator.value
+				? uint64_t{1} : uint64_t{0}
+				, VarType::Bool};
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(CompareNotEqual): {
 			auto lh = task->pop_value();
-			task->accumulator = Register{*vm,
-				(lh.vtype != task->accumulator.vtype
-				&& lh.value != task->accumulator.value
-				) ? uint64_t{1} : uint64_t{0}
+			task->accumulator = Register{
+				!same_value(lh, task->accumulator) ? uint64_t{1} : uint64_t{0}
 				, VarType::Bool};
-			task->show_vars(dbg);
-			break;
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::CompareEqual: {
+		FAE_CASE(CompareEqual): {
 			auto lh = task->pop_value();
-			task->accumulator = Register{*vm,
-				(lh.vtype == task->accumulator.vtype
-				&& lh.value == task->accumulator.value
-				) ? uint64_t{1} : uint64_t{0}
+			task->accumulator = Register{
+				same_value(lh, task->accumulator) ? uint64_t{1} : uint64_t{0}
 				, VarType::Bool};
-			task->show_vars(dbg);
-			break;
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		case Opcode::Not:
-			task->accumulator = Register{*vm, task->accumulator.value == 0
+		FAE_CASE(Not):
+			task->accumulator = Register{task->accumulator.value == 0
 				? uint64_t{1} : uint64_t{0}, VarType::Bool};
-			task->show_vars(dbg);
-			break;
-		case Opcode::Jump:
-			if(param > current_context->instructions.size()) {
-				param = current_context->instructions.size();
-			}
-			current_instruction = first_instruction + param;
-			continue;
-		case Opcode::JumpIf:
-			if(param > current_context->instructions.size()) {
-				param = current_context->instructions.size();
-			}
-			if(task->accumulator.value == 0) break;
-			current_instruction = first_instruction + param;
-			continue;
-		case Opcode::JumpElse:
-			if(param > current_context->instructions.size()) {
-				param = current_context->instructions.size();
-			}
-			if(task->accumulator.value != 0) break;
-			current_instruction = first_instruction + param;
-			continue;
-		case Opcode::LoadBool:
-			task->accumulator = Register{*vm, param, VarType::Bool};
-			break;
-		case Opcode::LoadUnit:
-			task->accumulator = Register{*vm, 0, VarType::Unit};
-			break;
-		case Opcode::ExitScope: {
+			task->show_vars(values);
+			FAE_NEXT();
+		FAE_CASE(Jump):
+			if(checked && param > current_context->code.size()) {
+				param = current_context->code.size();
+			}
+			FAE_JUMP();
+		FAE_CASE(JumpIf):
+			if(checked && param > current_context->code.size()) {
+				param = current_context->code.size();
+			}
+			if(task->accumulator.value == 0) FAE_NEXT();
+			FAE_JUMP();
+		FAE_CASE(JumpElse):
+			if(checked && param > current_context->code.size()) {
+				param = current_context->code.size();
+			}
+			if(task->accumulator.value != 0) FAE_NEXT();
+			FAE_JUMP();
+		FAE_CASE(LoadBool):
+			task->accumulator = Register{param, VarType::Bool};
+			FAE_NEXT();
+		FAE_CASE(LoadUnit):
+			task->accumulator = Register{0, VarType::Unit};
+			FAE_NEXT();
+		FAE_CASE(ExitScope): {
 			dbg << "TODO ExitScope\n";
-			task->show_vars(dbg);
-			break;
-		}
-		default:
-			dbg << "not implemented: " << current_instruction->opcode << '\n';
-			return;
+			task->show_vars(values);
+			FAE_NEXT();
 		}
-		current_instruction++;
-		if(++number_of_instructions_run > 1000) {
-			dbg << "instruction limit reached, script terminated.\n";
-			return;
+		FAE_CASE(StoreArg):
+		FAE_CASE(CompareSpaceship):
+		FAE_CASE_DEFAULT:
+			err << "not implemented: " << decoded.opcode << '\n';
+			return RunStatus::Error;
 		}
 	}
+	return RunStatus::Finished;
+}
+#undef FAE_FETCH
+#undef FAE_CASE
+#undef FAE_CASE_DEFAULT
+#undef FAE_DISPATCH
+#undef FAE_NEXT
+#undef FAE_CHARGE
+#undef FAE_JUMP
+
+static RunStatus run_task(FaeVM *vm, module_ptr module, bool resume) {
+	auto task = vm->current_task.get();
+	task->module = module;
+	if(vm->execution_mode == ExecutionMode::Fast && module->verified)
+		task->status = run_module<false>(vm, std::move(module), resume);
+	else
+		task->status = run_module<true>(vm, std::move(module), resume);
+	return task->status;
+}
+
+RunStatus ScriptContext::FunctionCall(const string_view func_name) {
+	FaeVM *vm = this->vm.get();
+	// a module that failed to load has no name string, find_string would complain about it
+	auto name = vm->str_index.find(func_name);
+	auto found = name == vm->str_index.cend() ? vm->script_map.cend() : vm->script_map.find(name->second);
+	if(found == vm->script_map.cend()) {
+		std::cerr << "Function not found: " << func_name << '\n';
+		return RunStatus::Error;
+	}
+	return run_task(vm, found->second, false);
+}
+
+RunStatus ScriptContext::Resume() {
+	auto task = vm->current_task.get();
+	if(task->status != RunStatus::OutOfFuel) return task->status;
+	return run_task(vm.get(), task->module, true);
 }
 
 }
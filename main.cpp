@@ -4,6 +4,8 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <filesystem>
+#include <charconv>
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
@@ -30,6 +32,7 @@ Fae::module_source_ptr load_syntax_tree(std::string_view const file) {
 
 int main(int argc, char**argv) {
 	std::vector<std::string_view> str_args;
+	std::fstream trace_file;
 	auto script = std::make_unique<Fae::ScriptContext>();
 	for(int i = 0; i < argc; i++) {
 		str_args.emplace_back(std::string_view(argv[i]));
@@ -37,9 +40,18 @@ int main(int argc, char**argv) {
 	bool once = true;
 	bool f_only_parse = false;
 	bool f_only_compile = false;
+	bool f_write_image = false;
+	bool f_compile_stats = false;
+	bool f_fuel = false;
+	bool f_resume = false;
+	uint64_t fuel_slice = Fae::unlimited_fuel;
+	bool f_gc_stats = false;
+	bool f_pause_budget = false;
+	bool f_gc_trigger = false;
 	bool f_flag_errors = false;
 	bool f_syntax_tree = false;
 	uint32_t verbose = 0;
+	uint32_t trace = 0;
 	bool any_files_were_processed = false;
 	Fae::module_source_ptr test_syntax_tree;
 	auto arg_itr = str_args.cbegin() + 1;
@@ -50,8 +62,22 @@ int main(int argc, char**argv) {
 		if(arg.size() >= 2 && arg[0] == '-' && arg[1] != '-') {
 			for(size_t sw = 1; sw < arg.size(); sw++) {
 				switch(arg[sw]) {
+				case 'b': f_write_image = true; break;
+				case 'C': script->SetExecutionMode(Fae::ExecutionMode::Checked); break;
+				case 'F': f_fuel = true; break;
+				case 'g': f_gc_stats = true; break;
+				case 'G': f_gc_trigger = true; break;
+				case 'P': f_pause_budget = true; break;
+				case 'R': f_resume = true; break;
 				case 'c': f_only_compile = true; break;
 				case 'p': f_only_parse = true; break;
+				case 'S': f_compile_stats = true; break;
+				case 't':
+					if(!trace_file.is_open())
+						trace_file.open("./debug.txt", std::ios_base::out | std::ios_base::trunc);
+					trace = std::min(trace + 1, static_cast<uint32_t>(Fae::TraceLevel::Values));
+					script->SetTrace(static_cast<Fae::TraceLevel>(trace), &trace_file);
+					break;
 				case 'T': f_syntax_tree = true; break;
 				case 'v': verbose++; break;
 				default:
@@ -60,7 +86,26 @@ int main(int argc, char**argv) {
 				}
 			}
 		} else if(!f_flag_errors) {
-			if(f_syntax_tree) {
+			if(f_fuel || f_pause_budget || f_gc_trigger) {
+				uint64_t number = 0;
+				auto [end_ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), number);
+				if(ec != std::errc{} || end_ptr != arg.data() + arg.size()) {
+					std::cerr << "invalid number: " << arg << '\n';
+					return 1;
+				}
+				if(f_fuel) {
+					f_fuel = false;
+					fuel_slice = number;
+					script->SetFuel(number);
+				} else if(f_gc_trigger) {
+					// collect after this many bytes, whatever survived the last collection
+					f_gc_trigger = false;
+					script->SetCollectorTrigger(number, 0);
+				} else {
+					f_pause_budget = false;
+					script->SetPauseBudget(number);
+				}
+			} else if(f_syntax_tree) {
 				f_syntax_tree = false;
 				test_syntax_tree = load_syntax_tree(arg);
 				if(!test_syntax_tree) return 1;
@@ -88,18 +133,58 @@ int main(int argc, char**argv) {
 						? 0 : 1;
 				}
 				if(verbose) {
-					//auto dbg_file = std::fstream("./debug.txt", std::ios_base::out | std::ios_base::trunc);
 					Fae::show_source_tree(std::cout, parsed_source);
 				}
 			} else if(f_only_compile) {
 				f_only_compile = false;
 				any_files_were_processed = true;
-				auto dbg_file = std::fstream("./debug.txt", std::ios_base::out | std::ios_base::trunc);
-				Fae::test_compile_sourcefile(dbg_file, arg);
+				// the compiler output goes to the trace file, when there is one
+				if(!Fae::test_compile_sourcefile(trace_file.is_open() ? trace_file : nullout, arg)) {
+					std::cerr << "could not compile: " << arg << '\n';
+					return 1;
+				}
+			} else if(f_write_image) {
+				f_write_image = false;
+				any_files_were_processed = true;
+				std::string source;
+				if(!Fae::LoadFileV(arg, source)) {
+					std::cerr << "could not load: " << arg << '\n';
+					return 1;
+				}
+				auto compiled = Fae::compile_sourcefile(trace_file.is_open() ? trace_file : nullout, std::move(source));
+				if(!compiled) {
+					std::cerr << "could not compile: " << arg << '\n';
+					return 1;
+				}
+				auto image_path = std::filesystem::path(arg).replace_extension(Fae::module_image_extension);
+				if(!Fae::write_module_image(std::cerr, compiled, image_path.string())) return 1;
+			} else if(f_compile_stats) {
+				f_compile_stats = false;
+				any_files_were_processed = true;
+				script->LoadScriptFile(arg, arg);
+				auto stats = script->GetCompileStats(arg);
+				if(!stats) return 1;
+				Fae::show_compile_stats(std::cout, *stats);
 			} else {
 				any_files_were_processed = true;
 				script->LoadScriptFile(arg, arg);
-				script->FunctionCall(arg);
+				auto status = script->FunctionCall(arg);
+				// -R refuels with the -F amount and resumes until the script stops
+				if(f_resume) {
+					uint64_t resumes = 0;
+					for(; status == Fae::RunStatus::OutOfFuel; resumes++) {
+						script->SetFuel(fuel_slice);
+						status = script->Resume();
+					}
+					std::cout << "resumes=" << resumes << '\n';
+				}
+				if(status == Fae::RunStatus::OutOfFuel) {
+					std::cerr << "out of fuel: " << arg << '\n';
+					return 3;
+				}
+				// the error itself was already written to stderr
+				if(status == Fae::RunStatus::Error) return 4;
+				if(f_gc_stats) Fae::show_gc_stats(std::cout, script->GetGcStats());
 			}
 		}
 	}
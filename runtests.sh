@@ -1,5 +1,8 @@
 set -e
-echo TODO pass in the built executable
+# usage: runtests.sh [path to the built fae executable]
+FAE="$(realpath "${1:-./build-n/fae}")"
+cd "$(dirname "$0")"
+FAILED=0
 
 function testcase() {
 	set -e
@@ -15,10 +18,49 @@ function testcase() {
 			TESTSPASSED=$(($TESTSPASSED + 1))
 		else
 			echo "$BASE_FILE FAIL"
+			FAILED=1
 		fi
 	done
 	echo "done ${TESTSPASSED}/${TESTCOUNT}"
 }
 
-find tests/ -name '*.tree' | testcase ./build-n/fae
+# execution tests: NAME.out is the expected stdout of running NAME.ffs,
+# followed by "exit: N" when the exit code is not 0.
+# optional NAME.args are flags put before the script, NAME.err is the expected stderr.
+# NAME.sh replaces the script run, it gets $FAE and a scratch directory $SCRATCH
+function runcase() {
+	set -e
+	TESTSPASSED=0
+	TESTCOUNT=0
+	SCRATCH="$(mktemp -d)"
+	while read OUTFILE; do
+		BASE_FILE="${OUTFILE%%.out}"
+		TESTCOUNT=$(($TESTCOUNT + 1))
+		echo -n $BASE_FILE
+		ARGS=""
+		if [ -f "${BASE_FILE}.args" ]; then ARGS="$(cat "${BASE_FILE}.args")"; fi
+		STATUS=0
+		if [ -f "${BASE_FILE}.sh" ]; then
+			ACTUAL="$(FAE="$1" SCRATCH="$SCRATCH" bash "${BASE_FILE}.sh" 2>"$SCRATCH/stderr")" || STATUS=$?
+		else
+			ACTUAL="$($1 $ARGS "${BASE_FILE}.ffs" 2>"$SCRATCH/stderr")" || STATUS=$?
+		fi
+		if [ $STATUS -ne 0 ]; then ACTUAL="${ACTUAL}"$'\n'"exit: ${STATUS}"; fi
+		if [ "$ACTUAL" == "$(cat "$OUTFILE")" ] &&
+			{ [ ! -f "${BASE_FILE}.err" ] || [ "$(cat "$SCRATCH/stderr")" == "$(cat "${BASE_FILE}.err")" ]; }; then
+			echo ' pass'
+			TESTSPASSED=$(($TESTSPASSED + 1))
+		else
+			echo " FAIL"
+			diff <(echo "$ACTUAL") "$OUTFILE" || true
+			cat "$SCRATCH/stderr"
+			FAILED=1
+		fi
+	done
+	rm -rf "$SCRATCH"
+	echo "done ${TESTSPASSED}/${TESTCOUNT}"
+}
 
+testcase "$FAE" < <(find tests/ -name '*.tree' | sort)
+runcase "$FAE" < <(find tests/ -name '*.out' | sort)
+exit $FAILED
@@ -87,7 +87,41 @@ module_source_ptr load_syntax_tree(string &&source);
 
 struct ModuleContext;
 typedef std::shared_ptr<ModuleContext> module_ptr;
+struct CompileStats {
+	// phase times in nanoseconds, the lexer time excludes collapse_expr
+	uint64_t lex_ns = 0;
+	uint64_t collapse_ns = 0;
+	uint64_t pass1_ns = 0;
+	uint64_t pass2_ns = 0;
+	uint64_t load_ns = 0;
+	uint64_t code_passes = 0;
+	uint64_t tokens = 0;
+	uint64_t ast_nodes = 0;
+	// approximate, from the sizes of the front end containers
+	uint64_t bytes_allocated = 0;
+	uint64_t frames = 0;
+	uint64_t instructions = 0;
+	uint64_t strings = 0;
+	uint64_t string_bytes = 0;
+};
+void show_compile_stats(std::ostream &out, const CompileStats &stats);
+constexpr size_t gc_pause_buckets = 40;
+// heap collector counters, bytes are estimates from the object sizes
+struct GcStats {
+	uint64_t collections = 0;
+	uint64_t objects_freed = 0;
+	uint64_t bytes_freed = 0;
+	// as of the last collection
+	uint64_t live_objects = 0;
+	uint64_t live_bytes = 0;
+	uint64_t total_ns = 0;
+	uint64_t max_pause_ns = 0;
+	// pause_histogram[n] counts pauses shorter than 2^n ns and at least 2^(n-1) ns
+	uint64_t pause_histogram[gc_pause_buckets] = {};
+};
+void show_gc_stats(std::ostream &out, const GcStats &stats);
 ModuleSource& get_source(const module_ptr &);
+const CompileStats& get_compile_stats(const module_ptr &);
 bool show_node_diff(std::ostream &out, const ASTNode &expected, const ASTNode &actual);
 void show_source_tree(std::ostream &out, const ModuleSource &source);
 void show_scopes(std::ostream &out, const ModuleContext &module);
@@ -96,16 +130,57 @@ void show_string_table(std::ostream &out, const ModuleContext &module);
 module_ptr compile_sourcefile(std::ostream &out, string file_source);
 module_ptr test_parse_sourcefile(std::ostream &dbg, const string_view file_path);
 module_ptr test_compile_sourcefile(std::ostream &dbg, const string_view file_path);
+constexpr string_view module_image_extension = ".ffc";
+bool write_module_image(std::ostream &dbg, const module_ptr &module, const string_view file_path);
+module_ptr load_module_image(std::ostream &dbg, const string_view file_path);
 
 struct FaeVM;
+enum class ExecutionMode : uint8_t {
+	Checked, // every instruction checks its operands
+	Fast, // verified modules skip the checks the verifier already proved
+};
+enum class RunStatus : uint8_t {
+	Finished,
+	OutOfFuel, // stopped at a call or backward jump, Resume continues from there
+	Error,
+};
+constexpr uint64_t unlimited_fuel = ~uint64_t{0};
+// each level includes the ones before it
+enum class TraceLevel : uint8_t {
+	Off,
+	Errors, // copies of the runtime errors, which always go to stderr
+	Load, // compiler output, string table and code of loaded modules
+	Calls, // frame exits and closures
+	Instructions, // every executed instruction
+	Values, // registers and stack after each instruction
+};
 class ScriptContext {
 public:
 
 	ScriptContext();
 	virtual ~ScriptContext();
 
-	virtual void FunctionCall(const string_view i);
+	virtual RunStatus FunctionCall(const string_view i);
+	// continues a call that ran out of fuel, otherwise returns the last status.
+	// the first call or backward jump reached always runs, even when it costs
+	// more than the fuel left, so every Resume makes progress
+	virtual RunStatus Resume();
 	virtual void LoadScriptFile(const string_view f, const string_view i);
+	const CompileStats *GetCompileStats(const string_view module_name) const;
+	void SetExecutionMode(ExecutionMode mode);
+	// fuel is used by calls and backward jumps, unlimited_fuel by default
+	void SetFuel(uint64_t fuel);
+	uint64_t GetFuel() const;
+	// collect once min_bytes, or growth_percent of the surviving heap, were allocated
+	void SetCollectorTrigger(uint64_t min_bytes, uint32_t growth_percent);
+	// 0, the default, collects in one pause. otherwise marking and sweeping
+	// are done in steps of about this many nanoseconds
+	void SetPauseBudget(uint64_t pause_budget_ns);
+	// collects cycles now, returns the bytes freed
+	uint64_t CollectGarbage();
+	const GcStats &GetGcStats() const;
+	// sink must outlive the script context, nullptr turns tracing off
+	void SetTrace(TraceLevel level, std::ostream *sink);
 private:
 	std::shared_ptr<FaeVM> vm;
 };
@@ -0,0 +1,4 @@
+# variables more levels up than the display window, in both execution modes
+cd "$(dirname "$0")"
+"$FAE" display01.ffs
+"$FAE" -C display01.ffs
@@ -0,0 +1,32 @@
+# errors reach stderr and the exit code with tracing off
+cd "$SCRATCH"
+run() {
+	echo "== $1"
+	printf '%s\n' "$2" > errors.ffs
+	"$FAE" errors.ffs 2>&1
+	echo "status $?"
+}
+run "type error" 'let a = "s"
+io.print(1)
+io.print(a * 2)
+io.print(3)'
+run "missing argument" 'let f (a, b) => .a + .b
+io.print(f(1))'
+run "member of a non-object" 'let n = 1
+io.print(n.b)'
+run "not a function" 'let n = 1
+n(2)'
+run "unknown variable" 'io.print(1)
+io.print(zzz)'
+run "break is not compiled" 'mut k = 0
+while k < 100 (
+	k = k + 3
+	if k > 20 (break)
+)'
+echo "== missing file"
+"$FAE" missing.ffs 2>&1
+echo "status $?"
+echo "== trace on"
+printf 'io.print(1 + "s")\n' > errors.ffs
+"$FAE" -t errors.ffs 2>&1
+echo "status $?"
@@ -0,0 +1,9 @@
+# budgets below the cost of one loop iteration still finish when resumed
+cd "$(dirname "$0")"
+for fuel in 0 1 2 7 40 100000; do
+	echo "== fuel $fuel"
+	"$FAE" -F $fuel fuel01.ffs 2>&1
+	echo "status $?"
+	"$FAE" -R -F $fuel fuel01.ffs 2>&1
+	echo "status $?"
+done
@@ -0,0 +1,8 @@
+# cycle collection, byte counts and times depend on the build so only object counts are compared
+cd "$(dirname "$0")"
+echo "== no collection until the VM goes away"
+"$FAE" -g gc01.ffs | grep -v -E '_ns|bytes'
+echo "== collect at every safepoint"
+"$FAE" -G 1 -g gc01.ffs | grep -v -E '_ns|bytes'
+echo "== collect every few iterations"
+"$FAE" -G 4096 gc01.ffs
@@ -0,0 +1,7 @@
+# incremental collection, a 1ns pause budget does one batch of work per safepoint.
+# byte counts and times depend on the build so only object counts are compared
+cd "$(dirname "$0")"
+echo "== single pause"
+"$FAE" -G 1 -g gc02.ffs | grep -v -E '_ns|bytes'
+echo "== one batch per safepoint"
+"$FAE" -G 1 -P 1 -g gc02.ffs | grep -v -E '_ns|bytes'
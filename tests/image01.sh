@@ -0,0 +1,36 @@
+# compiles image01.ffs to an image, runs it, then runs damaged copies of it
+cp "$(dirname "$0")/image01.ffs" "$SCRATCH/image01.ffs"
+cd "$SCRATCH"
+"$FAE" -b image01.ffs
+run() {
+	echo "== $1"
+	"$FAE" $2 "$1" 2>&1
+	echo "status $?"
+}
+run image01.ffc
+run image01.ffc -C
+SIZE=$(stat -c %s image01.ffc)
+chop() {
+	head -c $2 image01.ffc > cut$1.ffc
+	run cut$1.ffc
+}
+chop 0 0
+chop 1 7
+chop 2 16
+chop 3 31
+chop 4 40
+chop 5 $(($SIZE / 2))
+chop 6 $(($SIZE - 1))
+flip() {
+	cp image01.ffc flip$1.ffc
+	BYTE=$(od -An -tu1 -j $2 -N1 flip$1.ffc)
+	printf "$(printf '\\%03o' $((BYTE ^ $3)))" | dd of=flip$1.ffc bs=1 seek=$2 conv=notrunc status=none
+	run flip$1.ffc
+}
+# magic, version, checksum, a count, code and string bytes
+flip 1 0 1
+flip 2 8 2
+flip 3 24 128
+flip 4 32 4
+flip 5 $(($SIZE / 2)) 16
+flip 6 $(($SIZE - 1)) 1
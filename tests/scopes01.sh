@@ -0,0 +1,4 @@
+# pooled scopes in both execution modes
+cd "$(dirname "$0")"
+"$FAE" scopes01.ffs
+"$FAE" -C scopes01.ffs
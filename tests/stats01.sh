@@ -0,0 +1,2 @@
+# compile stats of stats01.ffs, times and allocation sizes vary so only their presence is checked
+"$FAE" -S "$(dirname "$0")/stats01.ffs" | sed -E 's/^([a-z0-9_]+_ns|bytes_allocated)=[0-9]+$/\1=N/'
@@ -0,0 +1,6 @@
+# object templates from source, then from a compiled image
+cp "$(dirname "$0")/templates01.ffs" "$SCRATCH/templates01.ffs"
+cd "$SCRATCH"
+"$FAE" templates01.ffs
+"$FAE" -b templates01.ffs
+"$FAE" templates01.ffc
@@ -0,0 +1,41 @@
+# patches an image of verify01.ffs, fixing up the checksum, so only the verifier can reject it
+cp "$(dirname "$0")/verify01.ffs" "$SCRATCH/verify01.ffs"
+cd "$SCRATCH"
+"$FAE" -b verify01.ffs
+run() {
+	echo "== $1"
+	"$FAE" $2 "$1" 2>&1
+	echo "status $?"
+}
+put_word() { # file, word index, value
+	local bytes="" v=$3
+	for i in 0 1 2 3 4 5 6 7; do
+		bytes+=$(printf '\\%03o' $(( (v >> (i * 8)) & 255 )))
+	done
+	printf "$bytes" | dd of="$1" bs=8 seek=$2 conv=notrunc status=none
+}
+fix_checksum() { # FNV-1a of everything after the 4 header words
+	local h=$((0xcbf29ce484222325))
+	for b in $(od -An -tu1 -v -j 32 "$1"); do h=$(( (h ^ b) * 1099511628211 )); done
+	put_word "$1" 3 $h
+}
+# word index of the first frame's max_stack
+WORDS=($(od -An -tu8 -v verify01.ffc))
+at=4
+at=$((at + 1 + 2 * WORDS[at])) # strings
+at=$((at + 1 + 2 * WORDS[at])) # imports
+at=$((at + 1 + WORDS[at])) # lines
+at=$((at + 1 + 3 * WORDS[at])) # divisors
+templates=${WORDS[at]}
+at=$((at + 1))
+for ((t = 0; t < templates; t++)); do at=$((at + 1 + WORDS[at])); done
+MAX_STACK=$((at + 2))
+
+cp verify01.ffc same.ffc
+fix_checksum same.ffc
+run same.ffc
+cp verify01.ffc shallow.ffc
+put_word shallow.ffc $MAX_STACK 0
+fix_checksum shallow.ffc
+run shallow.ffc
+run shallow.ffc -C
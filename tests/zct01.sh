@@ -0,0 +1,5 @@
+# the zero count table is reconciled at safepoints and after every collection
+cd "$(dirname "$0")"
+"$FAE" zct01.ffs
+"$FAE" -G 1 zct01.ffs
+"$FAE" -G 1 -P 1 zct01.ffs